@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// how well a bot plays, from BotSkillFor(difficulty)
+struct BotSkill {
+    float reaction_s;    // time between two looks at the ball
+    float aim_error;     // px, spread of the aimed paddle position
+    float anticipation;  // 0..1, how far it follows the ball while it moves away
+};
+
+// difficulty 0 (easy) .. 1 (almost perfect)
+BotSkill BotSkillFor(float difficulty);
+
+// server side paddles without socket, all bots are updated together
+// (structure of arrays, one slot per bot, the Think loop vectorizes across rooms)
+class BotPool {
+public:
+    int  Add(PlayerId side, float difficulty, uint32_t seed);  // return bot slot
+    void Remove(int bot);
+    const size_t get_count() const;
+
+    // world as seen by the bot, set before Think
+    void SetView(int bot, float ball_x, float ball_y, float ball_vx, float ball_vy, float paddle_y);
+    // predict where the ball meets the paddle, with the physics of StepBall, then pick a direction
+    void Think(float now_s);
+    // bits of its side, like a client input mask
+    const uint8_t get_input_mask(int bot) const;
+
+private:
+    // view
+    std::vector<float> ball_x_, ball_y_, ball_vx_, ball_vy_, paddle_y_;
+    // side: x of the ball when touching own paddle, the opponent one
+    std::vector<float> face_x_, far_x_;
+    // skill
+    std::vector<float> reaction_s_, aim_error_, anticipation_;
+    // decision
+    std::vector<float>    next_look_s_, target_y_;
+    std::vector<uint32_t> rng_;
+    std::vector<int8_t>   dir_;  // -1 up, 0 stay, 1 down
+
+    std::vector<PlayerId> side_;
+    std::vector<int>      free_;  // removed slots, reused first
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <array>
+#include <cstddef>
+
+// frame time percentiles over the last FRAME_HISTORY frames
+struct FrameStats {
+    float p50_ms;
+    float p95_ms;
+    float p99_ms;
+    float max_ms;
+};
+
+class FramePacer {
+public:
+    static constexpr size_t FRAME_HISTORY { 256 };
+
+    explicit FramePacer(float target_hz = 60.0f);
+
+    // vsync on: present blocks until vblank, the pacer sleeps after it so input is sampled
+    // just early enough for the frame work to make the next vblank
+    void set_vsync(bool vsync);
+    const bool get_vsync() const;
+
+    // sleep then spin until the next frame deadline, return frame time (s) since last call
+    float WaitForNextFrame();
+    // call right before present: ends the measured frame work
+    void BeginPresent();
+
+    FrameStats Stats() const;
+
+private:
+    Uint64 freq_;
+    Uint64 period_;     // in performance counter ticks
+    Uint64 deadline_;
+    Uint64 last_frame_;
+    bool   vsync_ { false };
+
+    // vsync: refresh interval and frame work, measured over the last VSYNC_HISTORY frames
+    static constexpr size_t VSYNC_HISTORY { 32 };
+    std::array<Uint64, VSYNC_HISTORY> vblank_interval_ {};
+    std::array<Uint64, VSYNC_HISTORY> work_ {};
+    size_t vsync_count_  { 0 };
+    Uint64 last_vblank_  { 0 };  // when present returned
+    Uint64 work_start_   { 0 };
+    Uint64 work_end_     { 0 };
+
+    std::array<float, FRAME_HISTORY> frame_ms_ {};
+    size_t frame_count_ { 0 };
+};
@@ -6,7 +6,10 @@
 #include <mutex>
 #include <queue>
 #include <optional>
+#include <atomic>
 #include "protocol.h"
+#include "frame_pacer.h"
+#include "latency_trace.h"
 
 // ball
 struct RectObject {
@@ -39,6 +42,7 @@ constexpr float PLAYER_SPEED  { 300.0f };
 constexpr float BALL_WIDTH    { 50.0f  };
 constexpr float BALL_HEIGHT   { 50.0f  };
 constexpr float BALL_SPEED    { 200.0f };
+constexpr float FIXED_DT      { 1.0f / 120.0f };  // simulation step, independent of frame rate
 
 class Game {
 private:
@@ -60,25 +64,50 @@ private:
     std::optional<GameStateMsg> latest_server_state_;
     std::mutex server_state_mutex_;
 
+    std::atomic<bool> server_lost_ { false };  // set by network thread, handled in ProcessNetEvents
+
     // info
     bool        is_online_;
     Tick        rtt_;
-    uint32_t    fps_;
+    InputRate   input_rate_;  // from server
+    uint32_t    fps_;  // from median frame time
+    uint8_t     server_tick_hz_     { 0 };  // room rate published by server
+    uint8_t     server_snapshot_hz_ { 0 };
+    FramePacer  pacer_;
+
+    // latency trace, on with env PONGNET_TRACE=<json file>
+    LatencyTracer tracer_;
+    const char*   trace_path_;
+    uint32_t      input_trace_id_;   // last key change, not sent yet
+    uint32_t      render_trace_id_;  // snapshot waiting to be presented
 
     // smooth animation
     SDL_FRect render_ball_;
     float     render_p1_y_;
     float     render_p2_y_;
 
+    // what is drawn, interpolated between the last two simulation steps
+    struct RenderState {
+        SDL_FRect ball;
+        float     p1_y;
+        float     p2_y;
+    };
+    RenderState prev_render_;
+
     void Init(const char* title);
     void HandleInput();
     void Update(float dt);
-    void Render();
+    RenderState CurrentRenderState() const;
+    void Render(float alpha);  // alpha: position between previous and current step, [0, 1)
     void Cleanup();
 
     // online
-    // each frame is processed once
+    // each frame is processed once, also while offline: InitMsg switches game to online
     void ProcessNetEvents();
+    void OnNetMessage(const InitMsg& msg);
+    void OnNetMessage(const GameStateMsg& msg);
+    void GoOnline(const InitMsg& msg);
+    void GoOffline();
     
     // send an input message per 50 frames
     void PredictLocalPlayer(float dt);
@@ -109,9 +138,18 @@ public:
     const bool get_is_online() const;
     void set_is_online(bool is_online);
     const PlayerId get_player_id() const;
+    const InputRate get_input_rate() const;
+    LatencyTracer& get_tracer();
+    uint32_t TakeInputTraceId();  // trace of the input about to be sent, 0 if none
     void set_player_id(PlayerId id);
     void AddNetEvent(const NetEvent& e);
+    void OnServerLost();  // thread safe, fall back to offline play
 };
 
 bool AABB_Collision(const SDL_FRect& a, const SDL_FRect& b);
+// continuous collision of `a` moving by (dx, dy) against static `b`
+// return time of impact as a fraction of the move, 1.0f if no hit (or already overlapping); normal is the hit side of `b`
+float SweptAABB(const SDL_FRect& a, float dx, float dy, const SDL_FRect& b, float& normal_x, float& normal_y);
+// move ball for dt seconds, bounce off paddles and window walls at the time of impact (no tunneling at any dt)
+void StepBall(SDL_FRect& ball, float& vx, float& vy, const SDL_FRect& p1, const SDL_FRect& p2, float dt);
 float Lerp(float a, float b, float t);
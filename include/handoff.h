@@ -0,0 +1,40 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// hot restart (linux only): a new server process asks the running one, over an abstract unix socket
+// of the port, for its state and all its fds (SCM_RIGHTS). the old one sends them between two loops
+// and exits, the new one carries on. both sides must speak the same version, else the old one refuses.
+
+class HandoffListener {
+public:
+    ~HandoffListener();
+    HandoffListener(const HandoffListener&)            = delete;
+    HandoffListener& operator=(const HandoffListener&) = delete;
+
+    // on running server: wait for a new server of port, nullptr if not supported or failed
+    static std::unique_ptr<HandoffListener> Listen(int port, uint32_t version);
+    // non-blocking, true when a new server of the same version asks (stops listening for others)
+    bool Requested();
+    // give it the state and the fds, true once it has them all: then stop using them and exit.
+    // false: it is gone, keep serving
+    bool Send(const std::vector<uint8_t>& state, const std::vector<int>& fds);
+
+private:
+    HandoffListener() = default;
+
+    int      port_          { 0 };
+    uint32_t version_       { 0 };
+    int      listen_fd_     { -1 };
+    int      peer_fd_       { -1 };  // new server that connected
+    Uint64   peer_since_ms_ { 0 };
+};
+
+// on new server: take state and fds of the server running on port.
+// false if there is none, it refused (other version) or it did not answer in time
+bool RequestHandoff(int port, uint32_t version, std::vector<uint8_t>& state, std::vector<int>& fds);
+// fds from RequestHandoff that could not be used
+void CloseHandedFds(const std::vector<int>& fds);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "protocol.h"
+
+// stages of one input on its way from key to screen (client clock)
+enum class TraceStage : uint8_t {
+    kSampled,     // key change seen in HandleInput
+    kSent,        // input message written to socket
+    kClientRecv,  // snapshot echoing the trace received, carries server side durations
+    kRendered     // first frame presented with that snapshot
+};
+
+// per-input latency trace, recorded from game and network thread without locks,
+// dumped as chrome trace-event json (open in chrome://tracing or ui.perfetto.dev)
+class LatencyTracer {
+public:
+    static constexpr size_t CAPACITY { 1 << 16 };  // records, later ones are dropped
+
+    void Enable();
+    const bool get_enabled() const;
+
+    uint32_t NewTraceId();
+    // server durations are from server receive, only for kClientRecv
+    void Record(uint32_t trace_id, TraceStage stage, Tick server_tick = 0, uint32_t server_apply_us = 0, uint32_t server_hold_us = 0);
+
+    bool DumpChromeTrace(const char* path) const;
+
+private:
+    struct Entry {
+        uint32_t   trace_id;
+        TraceStage stage;
+        Uint64     t_us;
+        Tick       server_tick;
+        uint32_t   server_apply_us;
+        uint32_t   server_hold_us;
+    };
+
+    bool                            enabled_ { false };
+    std::unique_ptr<Entry[]>             entries_;
+    std::unique_ptr<std::atomic<bool>[]> ready_;  // entry fully written
+    std::atomic<size_t>   next_     { 0 };
+    std::atomic<uint32_t> next_id_  { 1 };  // 0 means not traced
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// bad network conditions for one direction, applied per message
+struct NetSimProfile {
+    uint32_t delay_ms  { 0 };
+    uint32_t jitter_ms { 0 };     // +- random delay
+    float    loss      { 0.0f };  // probability, 0..1
+    float    duplicate { 0.0f };
+    float    reorder   { 0.0f };  // message may overtake earlier ones
+    uint32_t seed      { 1 };
+};
+
+// spec: "<profile>[,key=value...]", profile in off/lan/wifi/mobile/bad,
+// keys delay, jitter, loss, dup, reorder, seed. e.g. "mobile,loss=0.1,seed=7"
+bool ParseNetSimProfile(const std::string& spec, NetSimProfile& out);
+
+class NetSim {
+public:
+    using Deliver = std::function<void(const void* conn, const void* data, int size)>;
+
+    explicit NetSim(const NetSimProfile& profile);
+
+    // conn identifies the connection (socket), it is only compared, never dereferenced
+    void Push(const void* conn, const void* data, int size, Uint64 now_ms);
+    // deliver messages due at now_ms, in due order
+    void Pump(Uint64 now_ms, const Deliver& deliver);
+    // drop everything queued for a closed connection
+    void Forget(const void* conn);
+
+    void LogStats(const char* direction) const;
+
+private:
+    struct Pending {
+        Uint64      due_ms;
+        uint64_t    order;  // push order, keeps fifo for equal due time
+        const void* conn;
+        std::vector<uint8_t> data;
+    };
+
+    // random state per connection, so one client's traffic does not change what happens to another's
+    struct Link {
+        const void*  conn;
+        std::mt19937 rng;
+        Uint64       last_due;  // fifo unless reordered
+    };
+
+    Link& FindLink(const void* conn);
+    static bool Roll(std::mt19937& rng, float probability);
+    Uint64 Delay(std::mt19937& rng) const;
+
+    NetSimProfile        profile_;
+    std::vector<Pending> queue_;
+    std::vector<Link>    links_;
+    uint32_t             links_made_ { 0 };  // seeds the next link with (seed, index)
+    uint64_t             order_ { 0 };
+
+    uint64_t sent_       { 0 };
+    uint64_t dropped_    { 0 };
+    uint64_t duplicated_ { 0 };
+    uint64_t reordered_  { 0 };
+};
@@ -1,13 +1,46 @@
 #pragma once
 #include <SDL3_net/SDL_net.h>
+#include "net_sim.h"
+#include "shm_transport.h"
+#include "tcp_fd.h"
 #include <thread>
 #include <atomic>
 #include <functional>
 #include <mutex>
 #include <vector>
+#include <string>
 #include <iostream>
+#include <memory>
 
-using Clients = std::vector<NET_StreamSocket*>;
+enum class Transport : uint8_t {
+    kTcp,
+    kShm  // same host only (linux), skips the kernel network stack
+};
+
+// a peer connection: tcp stream socket (SDL_net, or plain fd on a linux server) or local shared memory channel
+struct Connection {
+    NET_StreamSocket*             tcp { nullptr };
+    std::unique_ptr<TcpFdChannel> tcp_fd;
+    std::unique_ptr<ShmChannel>   shm;
+
+    const void* key() const {
+        if (tcp)    return tcp;
+        if (tcp_fd) return tcp_fd.get();
+        return shm.get();
+    }
+    explicit operator bool() const { return tcp || tcp_fd || shm; }
+};
+
+using Clients = std::vector<Connection>;
+
+// hot restart (server, linux): every socket of a server as fds, for the process taking over
+struct SocketHandoff {
+    bool has_tcp_listener { false };
+    bool has_shm_listener { false };
+    std::vector<Transport>            client_transports;  // in client order
+    std::vector<std::vector<uint8_t>> client_unsent;      // tcp output the socket did not take yet
+    std::vector<int>                  fds;                // listeners, then each client (tcp 1, shm SHM_CHANNEL_FDS)
+};
 
 class NetworkManager {
 public:
@@ -19,37 +52,80 @@ public:
     NetworkManager& operator=(NetworkManager&&)      = delete;
 
 
-    // on client: init client and connect to server
-    bool ConnectToServer(const char* ip, int port);
+    // on client: init client and connect to server (kShm ignores ip, server must be on this host)
+    bool ConnectToServer(const char* ip, int port, Transport transport = Transport::kTcp);
+    // on client: connect in background thread (retry with backoff), result goes to HandleConnectResultCallback;
+    // reconnect: after losing the server, connect again the same way (a server restart does not end the session)
+    bool ConnectToServerAsync(const char* ip, int port, int max_attempts = 5, Transport transport = Transport::kTcp, bool reconnect = false);
 
     // on server
-    bool StartServer(int port);     // init server
+    bool StartServer(int port);     // init server (tcp + local shm)
     bool AcceptClients();           // call per frame in game
     void Broadcast(const void* data, int size); 
     void PollClients(std::function<void(int, const void*, int)> callback);  // callback parameters: index, data, data size
+    void DisconnectClient(int client_index);  // close it, HandleClientDisconnectedCallback is called as for a lost client
     const Clients& get_clients() const;
 
+    // hot restart: fds of the listeners and clients, still owned here (false if SDL_net sockets, they cannot move);
+    // once the new process has them, stop using this manager
+    bool ExportSockets(SocketHandoff& out);
+    // on the new server instead of StartServer: take the sockets over, adopted[i] false if client i was unusable
+    // (false: fds do not match, nothing taken)
+    bool AdoptSockets(const SocketHandoff& in, std::vector<bool>& adopted);
+
     // for client and server
     bool SendToServer(const void* data, int size);
     bool SendToClient(int client_index, const void* data, int size);
 
     // on client: client received message
     std::function<void(const void*, int)> HandleReceivedDataCallback;
+    // on client: async connect finished (called on network thread)
+    std::function<void(bool)> HandleConnectResultCallback;
+    // on client: connection to server lost (called on network thread)
+    std::function<void()> HandleServerDisconnectedCallback;
     // on server: client[index] disconnected
     std::function<void(int)> HandleClientDisconnectedCallback;
 
+    // bad network simulation between socket calls and callbacks, also enabled by env PONGNET_NETSIM=<spec>
+    // spec see ParseNetSimProfile, same profile for outgoing and incoming (incoming seed + 1),
+    // random state per connection: a seed replays each connection whatever the others send
+    bool EnableNetSim(const std::string& spec);
+    // bytes of the first complete message in a stream, 0 if incomplete;
+    // incoming messages are only simulated when this is set (a stream cannot be dropped by halves)
+    std::function<int(const void*, int)> MessageFramer;
+
 private:
-    void ClientReceiveLoop();
+    NET_StreamSocket* TryConnect(const std::string& ip, int port);  // interruptible by running_
+    Connection Connect(const std::string& ip, int port, Transport transport);
+    void ClientReceiveLoop();      // until the server is lost or this manager is destroyed
+    void CloseServerConnection();
+
+    static bool RawWrite(const Connection& c, const void* data, int size);
+    Connection* FindConnection(const void* key);
+
+    using Deliver = NetSim::Deliver;
+    bool WriteOut(const Connection& c, const void* data, int size);  // client: hold send_mutex_
+    void PumpOut();                                                   // client: hold send_mutex_
+    void ReceiveIn(const void* key, const void* data, int size, const Deliver& deliver);
+    void ForgetNetSim(const void* key);
 
 private:
     // for client
     std::atomic<bool> running_ { false };
-    NET_StreamSocket* client_socket_  { nullptr };
+    std::atomic<bool> client_active_ { false };  // network thread still connecting or connected
+    Connection  server_conn_;
     std::thread client_receive_thread_;
-    std::mutex send_mutex_;
+    std::mutex  send_mutex_;
 
     // for server
-    NET_Server* server_socket_ { nullptr };
+    NET_Server* server_socket_ { nullptr };          // where plain fds are not supported
+    std::unique_ptr<TcpFdListener> tcp_listener_;
+    std::unique_ptr<ShmListener>   shm_listener_;
     Clients clients_;
+
+    // network simulator, off when null
+    std::unique_ptr<NetSim> sim_out_;
+    std::unique_ptr<NetSim> sim_in_;
+    std::vector<std::pair<const void*, std::vector<uint8_t>>> sim_rx_;  // incoming bytes waiting for framing
 };
 
@@ -1,45 +1,175 @@
 #pragma once
 
 #include "common.h"
+#include "wire.h"
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <variant>
 
 using Tick = uint32_t;
 
+// bump on any change of message layout
+constexpr uint16_t PROTOCOL_VERSION { 5 };
+
+// value is the index in MessageRegistry, keep in the same order
 enum class MessageType : uint8_t {
     kInitMsg,
     kPlayerInputMsg,
     kGameStateMsg
 };
 
+// Dispatch result for a message type this build does not know: the stream cannot be resynced, close it
+constexpr size_t STREAM_BROKEN { SIZE_MAX };
+
+// previous input masks repeated in each input message, survive a lost message
+constexpr int INPUT_REDUNDANCY { 3 };
+
+// input upload limits, decided by server
+struct InputRate {
+    uint16_t min_interval_ms;  // at most one input message per interval
+    uint16_t heartbeat_ms;     // resend unchanged input after this long
+};
+
 // hand shake message
 struct InitMsg {
-    MessageType msg_type { MessageType::kInitMsg };
-    Tick     tick;
-    PlayerId p_id;
+    static constexpr MessageType TYPE { MessageType::kInitMsg };
+    MessageType msg_type { TYPE };
+    uint16_t  protocol_version { PROTOCOL_VERSION };  // keep right after msg_type: same offset in every version
+    Tick      tick;
+    PlayerId  p_id;
+    InputRate input_rate;
+
+    template <class Self, class F>
+    static constexpr void Fields(Self& m, F&& f) {
+        f(m.msg_type); f(m.protocol_version); f(m.tick); f(m.p_id);
+        f(m.input_rate.min_interval_ms); f(m.input_rate.heartbeat_ms);
+    }
 };
 
-// send input mask per frame
+// send input mask when it changes (and as heartbeat)
 struct PlayerInputMsg {
-    MessageType msg_type { MessageType::kPlayerInputMsg };
+    static constexpr MessageType TYPE { MessageType::kPlayerInputMsg };
+    MessageType msg_type { TYPE };
     Tick      tick;      // input moment
     Tick      client_time_ms;
     uint8_t   mask;      // bit 0/1/2/3 p1/2 up/down
     PlayerId  p_id;
+    uint32_t  seq;       // input sequence, start from 1
+    uint8_t   prev_masks[INPUT_REDUNDANCY];  // masks of seq-1, seq-2, ...
+    uint32_t  trace_id;  // latency trace of this input, 0 = not traced
+
+    template <class Self, class F>
+    static constexpr void Fields(Self& m, F&& f) {
+        f(m.msg_type); f(m.tick); f(m.client_time_ms); f(m.mask); f(m.p_id);
+        f(m.seq); f(m.prev_masks); f(m.trace_id);
+    }
 };
 
 // the whole key datas (regularly send to correct deviations)
 // world state(server keep)
 struct GameStateMsg {
-    MessageType msg_type { MessageType::kGameStateMsg };
+    static constexpr MessageType TYPE { MessageType::kGameStateMsg };
+    MessageType msg_type { TYPE };
     Tick  tick;    // server authentic tick
     Tick  echo_client_time_ms;
     float ball_x;
     float ball_y;
     float p1_y;
     float p2_y;
+
+    // latency trace echo, 0 = none; durations from server receive of that input
+    uint32_t echo_trace_id;
+    Tick     trace_tick;       // tick that applied the input
+    uint32_t trace_apply_us;   // until applied
+    uint32_t trace_hold_us;    // until this snapshot was sent
+
+    // current rate of this room, server lowers it under load
+    uint8_t tick_hz;
+    uint8_t snapshot_hz;
+
+    template <class Self, class F>
+    static constexpr void Fields(Self& m, F&& f) {
+        f(m.msg_type); f(m.tick); f(m.echo_client_time_ms);
+        f(m.ball_x); f(m.ball_y); f(m.p1_y); f(m.p2_y);
+        f(m.echo_trace_id); f(m.trace_tick); f(m.trace_apply_us); f(m.trace_hold_us);
+        f(m.tick_hz); f(m.snapshot_hz);
+    }
 };
 
-// transfrom every message type to byte streams
-struct NetEvent {
-    MessageType type;
-    std::vector<uint8_t> data;
+// MessageType -> layout, wire size and handler, all resolved at compile time
+template <class... Msgs>
+struct MessageRegistry {
+    static constexpr size_t COUNT { sizeof...(Msgs) };
+
+    static constexpr bool InTypeOrder() {
+        size_t i { 0 };
+        bool ok { true };
+        ((ok = ok && static_cast<size_t>(Msgs::TYPE) == i++), ...);
+        return ok;
+    }
+    static_assert(InTypeOrder(), "registry order must follow MessageType values");
+
+    static constexpr std::array<size_t, COUNT> WIRE_SIZES { wire::Size<Msgs>()... };
+
+    // handlers only need overloads for the messages they care about, others are skipped
+    template <class Handler, class Msg>
+    static void DecodeAndHandle(const uint8_t* p, Handler& h) {
+        if constexpr (std::is_invocable_v<Handler&, const Msg&>) {
+            Msg m {};
+            wire::Reader r { p };
+            Msg::Fields(m, r);
+            h(static_cast<const Msg&>(m));
+        }
+    }
+
+    // handle every complete message in data, return bytes consumed (keep the rest for next read)
+    // or STREAM_BROKEN at an unknown type (messages before it are handled)
+    template <class Handler>
+    static size_t Dispatch(const uint8_t* data, size_t size, Handler& h) {
+        struct Entry {
+            size_t size;
+            void (*handle)(const uint8_t*, Handler&);
+        };
+        static constexpr Entry TABLE[] { { wire::Size<Msgs>(), &DecodeAndHandle<Handler, Msgs> }... };
+
+        size_t used { 0 };
+        while (used < size) {
+            const uint8_t type { data[used] };
+            if (type >= COUNT) return STREAM_BROKEN;
+            const Entry& e { TABLE[type] };
+            if (size - used < e.size) break;  // partial message
+            e.handle(data + used, h);
+            used += e.size;
+        }
+        return used;
+    }
+
+    // bytes of the first message if complete, else 0 (unknown type: all bytes, the stream is lost anyway)
+    static size_t FrameSize(const uint8_t* data, size_t size) {
+        if (size == 0) return 0;
+        if (data[0] >= COUNT) return size;
+        return size >= WIRE_SIZES[data[0]] ? WIRE_SIZES[data[0]] : 0;
+    }
 };
+
+using Messages = MessageRegistry<InitMsg, PlayerInputMsg, GameStateMsg>;
+
+template <class Msg>
+using WireBuffer = std::array<uint8_t, wire::Size<Msg>()>;
+
+template <class Msg>
+WireBuffer<Msg> EncodeMessage(const Msg& m) {
+    WireBuffer<Msg> buf;
+    wire::Writer w { buf.data() };
+    Msg::Fields(m, w);
+    return buf;
+}
+
+template <class Handler>
+size_t DispatchMessages(const uint8_t* data, size_t size, Handler&& h) {
+    return Messages::Dispatch(data, size, h);
+}
+
+// server messages a client hands from network thread to game thread
+using NetEvent = std::variant<InitMsg, GameStateMsg>;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// local transport for clients on the same host as the server (linux only):
+// two single-producer/single-consumer byte rings in one memfd, eventfd wakeups,
+// and a unix socket that hands over the fds and tells when the peer is gone.
+// the byte stream behaves like a tcp stream, messages are framed by the reader.
+
+constexpr uint32_t SHM_RING_BYTES  { 1 << 16 };
+constexpr int      SHM_CHANNEL_FDS { 4 };  // unix socket, memfd, own and peer wake eventfd
+
+struct ShmRing {
+    alignas(64) std::atomic<uint32_t> head;      // bytes written, producer only
+    alignas(64) std::atomic<uint32_t> tail;      // bytes read, consumer only
+    alignas(64) std::atomic<uint32_t> sleeping;  // consumer waits on its eventfd, producer must wake it
+    uint8_t data[SHM_RING_BYTES];
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring is shared between processes");
+
+class ShmListener;
+
+class ShmChannel {
+public:
+    ~ShmChannel();
+    ShmChannel(const ShmChannel&)            = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    // on client: create a channel and hand it to the server listening on port, nullptr if failed
+    static std::unique_ptr<ShmChannel> Connect(int port);
+
+    bool Write(const void* data, int size);   // all or nothing, false if ring full or peer gone
+    int  Read(void* buf, int size);           // bytes read, 0 if none, -1 if peer is gone
+    void WaitReadable(int timeout_ms);        // sleep until data arrives or timeout
+
+    // hot restart (server side): fds of the channel, it keeps owning them
+    void get_fds(int (&fds)[SHM_CHANNEL_FDS]) const;
+    // take a server side channel handed over by the old server, nullptr if unusable (fds are closed)
+    static std::unique_ptr<ShmChannel> Adopt(const int (&fds)[SHM_CHANNEL_FDS]);
+
+private:
+    friend class ShmListener;
+    ShmChannel() = default;
+    bool Map(int mem_fd, bool is_server);
+
+    int      sock_fd_      { -1 };
+    int      mem_fd_       { -1 };
+    int      wake_self_fd_ { -1 };  // peer writes it when we sleep
+    int      wake_peer_fd_ { -1 };
+    void*    map_          { nullptr };
+    ShmRing* tx_           { nullptr };
+    ShmRing* rx_           { nullptr };
+    bool     peer_gone_    { false };
+    Uint64   last_alive_check_ms_ { 0 };
+};
+
+class ShmListener {
+public:
+    ~ShmListener();
+    ShmListener(const ShmListener&)            = delete;
+    ShmListener& operator=(const ShmListener&) = delete;
+
+    // on server: listen for local clients of port, nullptr if not supported or failed
+    static std::unique_ptr<ShmListener> Listen(int port);
+    // take a listening socket handed over by the old server
+    static std::unique_ptr<ShmListener> Adopt(int fd);
+    // non-blocking, nullptr if no client finished its handshake
+    std::unique_ptr<ShmChannel> Accept();
+
+    // hot restart: clients in the middle of their handshake are not handed over
+    const int get_fd() const;
+
+private:
+    ShmListener() = default;
+
+    // connected, fds not received yet
+    struct Pending {
+        int    fd;
+        Uint64 since_ms;
+    };
+
+    int listen_fd_ { -1 };
+    std::vector<Pending> pending_;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// server side tcp on plain posix sockets (linux only). unlike SDL_net sockets their fds can be
+// handed to another process, so a hot restart keeps the port and every client connection.
+// clients still use SDL_net, it is the same tcp stream on the wire.
+
+constexpr size_t TCP_FD_QUEUE_BYTES { 1 << 16 };  // output the socket did not take yet, more is refused
+
+class TcpFdChannel {
+public:
+    ~TcpFdChannel();
+    TcpFdChannel(const TcpFdChannel&)            = delete;
+    TcpFdChannel& operator=(const TcpFdChannel&) = delete;
+
+    // take a connected socket (accepted, or handed over by the old server), nullptr if unusable
+    static std::unique_ptr<TcpFdChannel> Adopt(int fd);
+
+    bool Write(const void* data, int size);  // all or nothing, queued if the socket is full, false if queue full or peer gone
+    int  Read(void* buf, int size);          // bytes read, 0 if none, -1 if peer is gone (also sends queued output)
+
+    // hot restart: socket and output not sent yet, the channel keeps owning them
+    const int get_fd() const;
+    const std::vector<uint8_t>& get_unsent() const;
+
+private:
+    explicit TcpFdChannel(int fd) : fd_(fd) {}
+    bool Flush();  // false if peer is gone
+
+    int  fd_        { -1 };
+    bool peer_gone_ { false };
+    std::vector<uint8_t> out_;
+};
+
+class TcpFdListener {
+public:
+    ~TcpFdListener();
+    TcpFdListener(const TcpFdListener&)            = delete;
+    TcpFdListener& operator=(const TcpFdListener&) = delete;
+
+    // listen on port of all interfaces, nullptr if not supported or failed
+    static std::unique_ptr<TcpFdListener> Listen(int port);
+    // take a listening socket handed over by the old server
+    static std::unique_ptr<TcpFdListener> Adopt(int fd);
+    // non-blocking, nullptr if no new client
+    std::unique_ptr<TcpFdChannel> Accept();
+
+    const int get_fd() const;
+
+private:
+    TcpFdListener() = default;
+
+    int fd_ { -1 };
+};
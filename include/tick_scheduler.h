@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <vector>
+
+struct RoomRate {
+    float tick_hz;
+    float snapshot_hz;
+};
+
+// degrade ladder: first fewer snapshots, then fewer ticks (swept collision keeps low tick rates correct)
+constexpr RoomRate RATE_LEVELS[] {
+    { 30.0f, 30.0f },  // full
+    { 30.0f, 15.0f },
+    { 30.0f, 10.0f },
+    { 20.0f, 10.0f },
+    { 15.0f,  5.0f },
+};
+constexpr int      RATE_LEVEL_COUNT { static_cast<int>(sizeof(RATE_LEVELS) / sizeof(RATE_LEVELS[0])) };
+constexpr RoomRate IDLE_RATE        { 1.0f, 1.0f };  // afk rooms
+
+// when a room ticks and sends snapshots
+struct RoomSchedule {
+    int    level            { 0 };      // index in RATE_LEVELS
+    bool   idle             { false };  // overrides level
+    Uint64 next_tick_ns     { 0 };
+    Uint64 next_snapshot_ns { 0 };
+
+    RoomRate rate() const;
+    void set_idle(bool idle, Uint64 now_ns);  // waking up ticks at once
+
+    // true when due, also moves the deadline (missed ones are skipped, not caught up)
+    bool TickDue(Uint64 now_ns);
+    bool SnapshotDue(Uint64 now_ns);
+    Uint64 NextDue() const;
+};
+
+// watches how much of the wall time rooms take and moves rooms along the ladder
+class TickScheduler {
+public:
+    // budget: fraction of wall time the host may spend on rooms before degrading
+    explicit TickScheduler(float budget = 0.5f);
+
+    void AddWork(Uint64 ns);
+    // call every loop, rooms in a stable order (degrade/recover a quarter of them per control period)
+    void Update(Uint64 now_ns, const std::vector<RoomSchedule*>& rooms);
+
+    const float get_load() const;
+
+private:
+    static constexpr Uint64 CONTROL_PERIOD_NS { 250 * SDL_NS_PER_MS };
+
+    float  budget_;
+    float  load_         { 0.0f };
+    Uint64 work_ns_      { 0 };
+    Uint64 window_start_ { 0 };
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// explicit wire format: fields packed in declaration order, little-endian, no padding.
+// a message lists its fields once in `Fields(msg, f)`, size/encode/decode all follow from it.
+namespace wire {
+
+template <class T>
+constexpr size_t FieldSize() {
+    static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "wire field must be a number or an enum");
+    return sizeof(T);
+}
+
+struct SizeCounter {
+    size_t size { 0 };
+
+    template <class T>
+    constexpr void operator()(const T&) { size += FieldSize<T>(); }
+    template <class T, size_t N>
+    constexpr void operator()(const T (&)[N]) { size += N * FieldSize<T>(); }
+};
+
+struct Writer {
+    uint8_t* p;
+
+    template <class T>
+    void operator()(const T& v) {
+        if constexpr (std::is_enum_v<T>) {
+            (*this)(static_cast<std::underlying_type_t<T>>(v));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            static_assert(sizeof(T) == sizeof(uint32_t), "only float on wire");
+            uint32_t u;
+            std::memcpy(&u, &v, sizeof(u));
+            (*this)(u);
+        } else {
+            const auto u { static_cast<std::make_unsigned_t<T>>(v) };
+            for (size_t i = 0; i < sizeof(T); ++i) *p++ = static_cast<uint8_t>(u >> (8 * i));
+        }
+    }
+    template <class T, size_t N>
+    void operator()(const T (&a)[N]) { for (const T& v : a) (*this)(v); }
+};
+
+struct Reader {
+    const uint8_t* p;
+
+    template <class T>
+    void operator()(T& v) {
+        if constexpr (std::is_enum_v<T>) {
+            std::underlying_type_t<T> u;
+            (*this)(u);
+            v = static_cast<T>(u);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            uint32_t u;
+            (*this)(u);
+            std::memcpy(&v, &u, sizeof(v));
+        } else {
+            std::make_unsigned_t<T> u { 0 };
+            for (size_t i = 0; i < sizeof(T); ++i) u |= static_cast<std::make_unsigned_t<T>>(*p++) << (8 * i);
+            v = static_cast<T>(u);
+        }
+    }
+    template <class T, size_t N>
+    void operator()(T (&a)[N]) { for (T& v : a) (*this)(v); }
+};
+
+// bytes of Msg on wire, known at compile time
+template <class Msg>
+constexpr size_t Size() {
+    Msg m {};
+    SizeCounter c;
+    Msg::Fields(m, c);
+    return c.size;
+}
+
+// records of varying count in one buffer (hot restart state): append them, take them back in order
+template <class Msg>
+void Append(std::vector<uint8_t>& out, const Msg& m) {
+    const size_t at { out.size() };
+    out.resize(at + Size<Msg>());
+    Writer w { out.data() + at };
+    Msg::Fields(m, w);
+}
+
+// false if fewer bytes are left than Msg takes
+template <class Msg>
+bool Take(const uint8_t*& p, const uint8_t* end, Msg& m) {
+    if (static_cast<size_t>(end - p) < Size<Msg>()) return false;
+    Reader r { p };
+    Msg::Fields(m, r);
+    p += Size<Msg>();
+    return true;
+}
+
+}  // namespace wire
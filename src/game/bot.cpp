@@ -0,0 +1,135 @@
+#include "bot.h"
+#include "game.h"
+#include <algorithm>
+#include <cmath>
+
+BotSkill BotSkillFor(float difficulty) {
+    const float d { std::clamp(difficulty, 0.0f, 1.0f) };
+    return BotSkill {
+        Lerp(0.8f, 0.05f, d),
+        Lerp(PLAYER_HEIGHT * 3.0f, PLAYER_HEIGHT * 0.1f, d),  // wider than the paddle: easy bots miss
+        d,
+    };
+}
+
+int BotPool::Add(PlayerId side, float difficulty, uint32_t seed) {
+    int bot;
+    if (!free_.empty()) {
+        bot = free_.back();
+        free_.pop_back();
+    } else {
+        bot = static_cast<int>(side_.size());
+        for (auto* v : { &ball_x_, &ball_y_, &ball_vx_, &ball_vy_, &paddle_y_, &face_x_, &far_x_,
+                         &reaction_s_, &aim_error_, &anticipation_, &next_look_s_, &target_y_ }) {
+            v->push_back(0.0f);
+        }
+        rng_.push_back(0);
+        dir_.push_back(0);
+        side_.push_back(side);
+    }
+
+    constexpr float LEFT_FACE  { PLAYER_WIDTH };                               // ball x touching p1
+    constexpr float RIGHT_FACE { WINDOW_WIDTH - PLAYER_WIDTH - BALL_WIDTH };  // ball x touching p2
+    const bool  left  { side == PlayerId::kPlayer1 };
+    const BotSkill skill { BotSkillFor(difficulty) };
+
+    side_[bot]         = side;
+    face_x_[bot]       = left ? LEFT_FACE : RIGHT_FACE;
+    far_x_[bot]        = left ? RIGHT_FACE : LEFT_FACE;
+    reaction_s_[bot]   = skill.reaction_s;
+    aim_error_[bot]    = skill.aim_error;
+    anticipation_[bot] = skill.anticipation;
+    next_look_s_[bot]  = 0.0f;
+    target_y_[bot]     = (WINDOW_HEIGHT - PLAYER_HEIGHT) / 2.0f;
+    rng_[bot]          = seed | 1;  // xorshift state must not be 0
+    dir_[bot]          = 0;
+    return bot;
+}
+
+void BotPool::Remove(int bot) {
+    dir_[bot]         = 0;
+    next_look_s_[bot] = 1e30f;  // never looks again, until the slot is reused
+    free_.push_back(bot);
+}
+
+const size_t BotPool::get_count() const { return side_.size() - free_.size(); }
+
+void BotPool::SetView(int bot, float ball_x, float ball_y, float ball_vx, float ball_vy, float paddle_y) {
+    ball_x_[bot]   = ball_x;
+    ball_y_[bot]   = ball_y;
+    ball_vx_[bot]  = ball_vx;
+    ball_vy_[bot]  = ball_vy;
+    paddle_y_[bot] = paddle_y;
+}
+
+// no branches and no calls in the loop, so it vectorizes across bots (gcc needs -fno-trapping-math,
+// see CMakeLists.txt); restrict parameters: the arrays never overlap, no alias checks
+static void ThinkAll(size_t n, float now_s,
+                     const float* __restrict ball_x, const float* __restrict ball_y,
+                     const float* __restrict ball_vx, const float* __restrict ball_vy,
+                     const float* __restrict paddle_y, const float* __restrict face_x, const float* __restrict far_x,
+                     const float* __restrict reaction_s, const float* __restrict aim_error,
+                     const float* __restrict anticipation,
+                     float* __restrict next_look_s, float* __restrict target_y,
+                     uint32_t* __restrict rng, int8_t* __restrict dir) {
+    constexpr float RANGE_Y  { WINDOW_HEIGHT - BALL_HEIGHT };  // ball y between walls
+    constexpr float CENTER_Y { (WINDOW_HEIGHT - PLAYER_HEIGHT) / 2.0f };
+    constexpr float MAX_Y    { WINDOW_HEIGHT - PLAYER_HEIGHT };
+    constexpr float DEADZONE { 8.0f };  // px, do not shake around the target
+
+    for (size_t i = 0; i < n; ++i) {
+        const float x    { ball_x[i] };
+        const float vx   { ball_vx[i] };
+        const float face { face_x[i] };
+        const float far  { far_x[i] };
+
+        // distance the ball travels until own paddle, by the opponent paddle when moving away
+        const float toward { static_cast<float>((face - x) * vx > 0.0f) };  // 1 or 0, blends instead of branches
+        const float near_d { std::fabs(face - x) };
+        const float far_d  { std::fabs(far - x) + std::fabs(far - face) };
+        const float t      { (far_d + toward * (near_d - far_d)) / std::max(std::fabs(vx), 1.0f) };
+
+        // walls reflect the ball: unfold y on a 2*RANGE_Y period (floor by truncation, std::floor stops vectorization)
+        const float y   { ball_y[i] + ball_vy[i] * t };
+        const float q   { y * (0.5f / RANGE_Y) };
+        const float tq  { static_cast<float>(static_cast<int32_t>(q)) };
+        const float m   { y - 2.0f * RANGE_Y * (tq - static_cast<float>(tq > q)) };
+        const float hit { RANGE_Y - std::fabs(m - RANGE_Y) };
+
+        const float predicted { hit + (BALL_HEIGHT - PLAYER_HEIGHT) / 2.0f };
+        const float follow    { toward + (1.0f - toward) * anticipation[i] };
+        const float aim       { CENTER_Y + (predicted - CENTER_Y) * follow };
+
+        // look at the ball only every reaction_s, aim with some error
+        uint32_t r { rng[i] };
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        const float noise { (static_cast<float>(r >> 8) * (1.0f / 16777216.0f) - 0.5f) * aim_error[i] };
+        const float aimed { std::min(std::max(aim + noise, 0.0f), MAX_Y) };
+
+        const float    look { static_cast<float>(now_s >= next_look_s[i]) };
+        const uint32_t keep { static_cast<uint32_t>(look) - 1u };  // all bits set when not looking
+        target_y[i]    += look * (aimed - target_y[i]);
+        next_look_s[i] += look * (now_s + reaction_s[i] - next_look_s[i]);
+        rng[i]          = (rng[i] & keep) | (r & ~keep);
+
+        const float diff { target_y[i] - paddle_y[i] };
+        dir[i] = static_cast<int8_t>(static_cast<int>(diff > DEADZONE) - static_cast<int>(diff < -DEADZONE));
+    }
+}
+
+void BotPool::Think(float now_s) {
+    ThinkAll(side_.size(), now_s,
+             ball_x_.data(), ball_y_.data(), ball_vx_.data(), ball_vy_.data(),
+             paddle_y_.data(), face_x_.data(), far_x_.data(),
+             reaction_s_.data(), aim_error_.data(), anticipation_.data(),
+             next_look_s_.data(), target_y_.data(), rng_.data(), dir_.data());
+}
+
+const uint8_t BotPool::get_input_mask(int bot) const {
+    const int up_bit { side_[bot] == PlayerId::kPlayer1 ? 0 : 2 };  // down is the next bit
+    if (dir_[bot] < 0) return static_cast<uint8_t>(1 << up_bit);
+    if (dir_[bot] > 0) return static_cast<uint8_t>(1 << (up_bit + 1));
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "frame_pacer.h"
+#include <algorithm>
+
+// OS sleep wakes up late by up to ~1-2ms, spin the last part
+constexpr Uint64 SPIN_NS { 2 * SDL_NS_PER_MS };
+// vsync: wake this much before the latest start that still makes the vblank
+constexpr Uint64 VSYNC_MARGIN_NS { 2 * SDL_NS_PER_MS };
+
+FramePacer::FramePacer(float target_hz) {
+    freq_       = SDL_GetPerformanceFrequency();
+    period_     = static_cast<Uint64>(freq_ / target_hz);
+    last_frame_ = SDL_GetPerformanceCounter();
+    deadline_   = last_frame_ + period_;
+}
+
+void FramePacer::set_vsync(bool vsync) { vsync_ = vsync; }
+const bool FramePacer::get_vsync() const { return vsync_; }
+
+void FramePacer::BeginPresent() { work_end_ = SDL_GetPerformanceCounter(); }
+
+// sleep then spin until counter reaches deadline, return the counter after waiting
+static Uint64 WaitUntil(Uint64 deadline, Uint64 freq) {
+    Uint64 now { SDL_GetPerformanceCounter() };
+    if (now >= deadline) return now;
+    const Uint64 remain_ns { (deadline - now) * SDL_NS_PER_SECOND / freq };
+    if (remain_ns > SPIN_NS) SDL_DelayNS(remain_ns - SPIN_NS);
+    while ((now = SDL_GetPerformanceCounter()) < deadline) {}
+    return now;
+}
+
+float FramePacer::WaitForNextFrame() {
+    Uint64 now { SDL_GetPerformanceCounter() };
+
+    if (!vsync_) {
+        now = WaitUntil(deadline_, freq_);
+        // fixed cadence; after a long stall start over instead of rushing frames
+        deadline_ += period_;
+        if (deadline_ < now) deadline_ = now + period_;
+    } else {
+        // present just returned: this is (about) a vblank
+        if (last_vblank_ && work_end_ > work_start_) {
+            vblank_interval_[vsync_count_ % VSYNC_HISTORY] = now - last_vblank_;
+            work_[vsync_count_ % VSYNC_HISTORY]            = work_end_ - work_start_;
+            vsync_count_++;
+        }
+        last_vblank_ = now;
+
+        // median interval is the refresh period (missed vblanks are outliers), worst recent work is the budget
+        if (vsync_count_ >= VSYNC_HISTORY) {
+            std::array<Uint64, VSYNC_HISTORY> sorted { vblank_interval_ };
+            std::nth_element(sorted.begin(), sorted.begin() + VSYNC_HISTORY / 2, sorted.end());
+            const Uint64 refresh { sorted[VSYNC_HISTORY / 2] };
+            const Uint64 work    { *std::max_element(work_.begin(), work_.end()) };
+            const Uint64 margin  { VSYNC_MARGIN_NS * freq_ / SDL_NS_PER_SECOND };
+            if (work + margin < refresh) now = WaitUntil(last_vblank_ + refresh - work - margin, freq_);
+        }
+        work_start_ = now;
+    }
+
+    const float dt { static_cast<float>(now - last_frame_) / static_cast<float>(freq_) };
+    last_frame_ = now;
+    frame_ms_[frame_count_ % FRAME_HISTORY] = dt * 1000.0f;
+    frame_count_++;
+    return dt;
+}
+
+FrameStats FramePacer::Stats() const {
+    const size_t n { std::min(frame_count_, FRAME_HISTORY) };
+    if (n == 0) return FrameStats { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    std::array<float, FRAME_HISTORY> sorted { frame_ms_ };
+    std::sort(sorted.begin(), sorted.begin() + n);
+    auto at = [&](float p) { return sorted[static_cast<size_t>(p * (n - 1))]; };
+    return FrameStats { at(0.50f), at(0.95f), at(0.99f), sorted[n - 1] };
+}
@@ -1,4 +1,6 @@
 #include "game.h"
+#include <algorithm>
+#include <limits>
 
 Game::Game() {
     Init("PongNet");
@@ -8,63 +10,97 @@ Game::~Game() {
     Cleanup();
 }
 void Game::Loop() {
-    const float freq = 1.0f / (float)SDL_GetPerformanceFrequency();
-    Uint64 prev = SDL_GetPerformanceCounter();
+    float accumulator { 0.0f };
+    bool  first_frame { true };
     while (running_) {
+        // wait for the frame deadline first, then sample input as late as possible before present
+        accumulator += std::min(pacer_.WaitForNextFrame(), 0.25f);  // do not try to catch up long stalls
+
         HandleInput();
+        ProcessNetEvents();  // eat server state firstly (latest server state + local prediction = current frame rendering)
         if (is_online_) {
-            ProcessNetEvents();  // eat server state firstly (latest server state + local prediction = current frame rendering)
             if(Send2ServerCallback) Send2ServerCallback();  // online, accept state_mask_ and position
         }
 
-        Uint64 now = SDL_GetPerformanceCounter();
-        float  dt  = (now - prev) * freq;
-        prev       = now;
-        if (dt > 0.0f) fps_ = 1.0f / dt;
-        Update(dt);
-        Render();
+        // fixed step simulation
+        while (accumulator >= FIXED_DT) {
+            prev_render_ = CurrentRenderState();
+            Update(FIXED_DT);
+            accumulator -= FIXED_DT;
+        }
+        Render(accumulator / FIXED_DT);
+        if (render_trace_id_) {
+            tracer_.Record(render_trace_id_, TraceStage::kRendered);
+            render_trace_id_ = 0;
+        }
 
-        SDL_Delay(16);
+        if (first_frame) {
+            SDL_Log("first frame at %llu ms", static_cast<unsigned long long>(SDL_GetTicks()));
+            first_frame = false;
+        }
     }
 }
 
 void Game::ProcessNetEvents() {
+    if (server_lost_.exchange(false)) GoOffline();
+
     std::lock_guard<std::mutex> lock(net_event_mutex_);
     while (!net_events_.empty()) {
-        auto& ne { net_events_.front() };
-
-        switch (ne.type) {
-        case MessageType::kInitMsg: {
-            auto* msg { reinterpret_cast<InitMsg*>(ne.data.data()) };
-            player_id_ = msg->p_id;
-            if (player_id_ == PlayerId::kPlayer1) {
-                player1_.color = SDL_Color { 0, 255, 0, 255 };
-                SDL_Log("you are player 1 (left side), use w/s control move.");
-            } else if(player_id_ == PlayerId::kPlayer2) {
-                player2_.color = SDL_Color { 0, 255, 0, 255 };
-                SDL_Log("you are player 2 (right side), use ↑/↓ control move.");
-            }
-            break;
-        }
-        // case MessageType::kPlayerInputMsg: {
-        //     auto* msg { reinterpret_cast<PlayerInputMsg*>(ne.data.data()) };
-        //     state_mask_ |= (msg->mask & 0x0F);
-        //     break;
-        // }
-        case MessageType::kGameStateMsg: {
-            auto* msg { reinterpret_cast<GameStateMsg*>(ne.data.data()) };
-            std::lock_guard<std::mutex> lock(server_state_mutex_);
-            latest_server_state_ = *msg;
-            break;
-        }
-        default:
-            break;
-        }
-
+        std::visit([this](const auto& msg) { OnNetMessage(msg); }, net_events_.front());
         net_events_.pop();
     }
 }
 
+void Game::OnNetMessage(const InitMsg& msg) {
+    if (msg.protocol_version != PROTOCOL_VERSION) {
+        SDL_Log("server protocol v%u, client v%u, stay offline.", msg.protocol_version, PROTOCOL_VERSION);
+        return;
+    }
+    GoOnline(msg);
+}
+
+void Game::OnNetMessage(const GameStateMsg& msg) {
+    if (!is_online_) return;  // late message after falling back to offline
+    if (msg.echo_trace_id) render_trace_id_ = msg.echo_trace_id;
+    std::lock_guard<std::mutex> lock(server_state_mutex_);
+    latest_server_state_ = msg;
+}
+
+void Game::GoOnline(const InitMsg& msg) {
+    // hand off: server state takes over, start interpolating from what is on screen now
+    is_online_   = true;
+    player_id_   = msg.p_id;
+    input_rate_  = msg.input_rate;
+    render_ball_ = rect_object_.body;
+    render_p1_y_ = player1_.body.y;
+    render_p2_y_ = player2_.body.y;
+    {
+        std::lock_guard<std::mutex> lock(server_state_mutex_);
+        latest_server_state_.reset();
+    }
+
+    if (player_id_ == PlayerId::kPlayer1) {
+        player1_.color = SDL_Color { 0, 255, 0, 255 };
+        SDL_Log("you are player 1 (left side), use w/s control move.");
+    } else if(player_id_ == PlayerId::kPlayer2) {
+        player2_.color = SDL_Color { 0, 255, 0, 255 };
+        SDL_Log("you are player 2 (right side), use ↑/↓ control move.");
+    }
+    SDL_Log("online at %llu ms", static_cast<unsigned long long>(SDL_GetTicks()));
+}
+
+void Game::GoOffline() {
+    if (!is_online_) return;
+
+    // keep playing from the last rendered state
+    is_online_ = false;
+    rect_object_.body = render_ball_;
+    player1_.body.y   = render_p1_y_;
+    player2_.body.y   = render_p2_y_;
+    player1_.color = player2_.color = PLAYER_COLOR;
+    SDL_Log("server lost, back to offline play.");
+}
+
 void Game::PredictLocalPlayer(float dt) {
     if (player_id_ == PlayerId::kPlayer1) {
         if (state_mask_ & (1 << 0))
@@ -86,8 +122,10 @@ void Game::InterpolateFromServer(float dt) {
 
     // calculate rtt
     rtt_ = SDL_GetTicks() - latest_server_state_->echo_client_time_ms;
+    server_tick_hz_     = latest_server_state_->tick_hz;
+    server_snapshot_hz_ = latest_server_state_->snapshot_hz;
 
-    constexpr float SMOOTH { 0.32f };
+    constexpr float SMOOTH { 0.175f };  // per FIXED_DT step (about 0.32 per 60Hz frame)
 
     // ball
     render_ball_.x = Lerp(render_ball_.x, latest_server_state_->ball_x, SMOOTH);
@@ -130,11 +168,19 @@ void  Game::set_player(PlayerId id, const Player& p) {
 const bool Game::get_is_online() const { return is_online_; }
 void Game::set_is_online(bool is_online) { is_online_ = is_online; }
 const PlayerId Game::get_player_id() const { return player_id_; }
+const InputRate Game::get_input_rate() const { return input_rate_; }
+LatencyTracer& Game::get_tracer() { return tracer_; }
+uint32_t Game::TakeInputTraceId() {
+    const uint32_t id { input_trace_id_ };
+    input_trace_id_ = 0;
+    return id;
+}
 void Game::set_player_id(PlayerId id) { player_id_ = id; }
 void Game::AddNetEvent(const NetEvent& e) {
     std::lock_guard<std::mutex> lock(net_event_mutex_);
     net_events_.push(std::move(e));
 }
+void Game::OnServerLost() { server_lost_ = true; }
 
 
 
@@ -174,8 +220,23 @@ void Game::Init(const char* title) {
     render_ball_ = rect_object_.body;
     render_p1_y_ = player1_.body.y;
     render_p2_y_ = player2_.body.y;
+    prev_render_ = RenderState { rect_object_.body, player1_.body.y, player2_.body.y };
+
+    // let the display pace frames if it can, otherwise FramePacer does
+    pacer_.set_vsync(SDL_SetRenderVSync(renderer_.get(), 1));
+    SDL_Log("vsync: %s", pacer_.get_vsync() ? "on" : "off");
+    fps_ = 0;
+    rtt_ = 0;
+
+    input_trace_id_ = render_trace_id_ = 0;
+    trace_path_ = SDL_getenv("PONGNET_TRACE");
+    if (trace_path_) {
+        tracer_.Enable();
+        SDL_Log("latency trace on, dump to %s at exit", trace_path_);
+    }
 
     player_id_ = PlayerId::kPlayer1;
+    input_rate_ = InputRate { 50, 50 };  // old fixed 20Hz until server tells
 
     running_ = true;
     is_online_ = false;
@@ -183,6 +244,7 @@ void Game::Init(const char* title) {
 }
 
 void Game::Cleanup() {
+    if (trace_path_) tracer_.DumpChromeTrace(trace_path_);
     SDL_Quit();
 }
 
@@ -192,22 +254,30 @@ void Game::RenderInfo() {
     if (now - last_render < 3000) return;   // 3s
 
     // print as render
-    SDL_Log("fps: %u, rtt: %u ms", fps_, rtt_);
+    const FrameStats fs { pacer_.Stats() };
+    if (fs.p50_ms > 0.0f) fps_ = static_cast<uint32_t>(1000.0f / fs.p50_ms);
+    SDL_Log("frame time p50/p95/p99/max: %.2f/%.2f/%.2f/%.2f ms (%u fps), rtt: %u ms",
+            fs.p50_ms, fs.p95_ms, fs.p99_ms, fs.max_ms, fps_, rtt_);
+    if (is_online_) SDL_Log("server room rate: %u Hz tick, %u Hz snapshot", server_tick_hz_, server_snapshot_hz_);
 
     last_render = now;
 }
 
-void Game::Render() {
-    SDL_FRect ball { rect_object_.body  };
-    SDL_FRect p1   { player1_.body };
-    SDL_FRect p2   { player2_.body }; 
-    
+Game::RenderState Game::CurrentRenderState() const {
     // smooth animation
-    if (is_online_) {
-        ball = render_ball_;
-        p1.y = render_p1_y_;
-        p2.y = render_p2_y_;
-    }
+    if (is_online_) return RenderState { render_ball_, render_p1_y_, render_p2_y_ };
+    return RenderState { rect_object_.body, player1_.body.y, player2_.body.y };
+}
+
+void Game::Render(float alpha) {
+    const RenderState cur { CurrentRenderState() };
+    SDL_FRect ball { cur.ball };
+    SDL_FRect p1   { player1_.body };
+    SDL_FRect p2   { player2_.body };
+    ball.x = Lerp(prev_render_.ball.x, cur.ball.x, alpha);
+    ball.y = Lerp(prev_render_.ball.y, cur.ball.y, alpha);
+    p1.y   = Lerp(prev_render_.p1_y, cur.p1_y, alpha);
+    p2.y   = Lerp(prev_render_.p2_y, cur.p2_y, alpha);
 
     SDL_SetRenderDrawColor(renderer_.get(), BG_COLOR.r, BG_COLOR.g, BG_COLOR.b, BG_COLOR.a);
     SDL_RenderClear(renderer_.get());
@@ -221,6 +291,7 @@ void Game::Render() {
 
     RenderInfo();
 
+    pacer_.BeginPresent();
     SDL_RenderPresent(renderer_.get());
 }
 
@@ -245,6 +316,7 @@ void Game::HandleInput() {
     if (keys[SDL_SCANCODE_UP])      input_mask |= 1 << 2;
     if (keys[SDL_SCANCODE_DOWN])    input_mask |= 1 << 3;
 
+    const uint8_t prev_input { static_cast<uint8_t>(state_mask_ & 0x0F) };
     state_mask_ &= 0xF0;       // keep rect object move, reset player move state
 
     if (is_online_) {
@@ -261,6 +333,12 @@ void Game::HandleInput() {
     } else {
         state_mask_ |= input_mask;
     }
+
+    // start a latency trace on every key change
+    if (is_online_ && (state_mask_ & 0x0F) != prev_input && tracer_.get_enabled()) {
+        input_trace_id_ = tracer_.NewTraceId();
+        tracer_.Record(input_trace_id_, TraceStage::kSampled);
+    }
 }
 
 bool AABB_Collision(const SDL_FRect& a, const SDL_FRect& b) {
@@ -270,6 +348,95 @@ bool AABB_Collision(const SDL_FRect& a, const SDL_FRect& b) {
            a.y + a.h > b.y;
 }
 
+float SweptAABB(const SDL_FRect& a, float dx, float dy, const SDL_FRect& b, float& normal_x, float& normal_y) {
+    constexpr float INF { std::numeric_limits<float>::infinity() };
+    normal_x = normal_y = 0.0f;
+
+    // distance to start/stop touching on each axis
+    float x_entry, x_exit, y_entry, y_exit;
+    if (dx > 0.0f) {
+        x_entry = (b.x - (a.x + a.w)) / dx;
+        x_exit  = ((b.x + b.w) - a.x) / dx;
+    } else if (dx < 0.0f) {
+        x_entry = ((b.x + b.w) - a.x) / dx;
+        x_exit  = (b.x - (a.x + a.w)) / dx;
+    } else if (a.x < b.x + b.w && a.x + a.w > b.x) {
+        x_entry = -INF;
+        x_exit  =  INF;
+    } else {
+        return 1.0f;  // never overlap on x
+    }
+
+    if (dy > 0.0f) {
+        y_entry = (b.y - (a.y + a.h)) / dy;
+        y_exit  = ((b.y + b.h) - a.y) / dy;
+    } else if (dy < 0.0f) {
+        y_entry = ((b.y + b.h) - a.y) / dy;
+        y_exit  = (b.y - (a.y + a.h)) / dy;
+    } else if (a.y < b.y + b.h && a.y + a.h > b.y) {
+        y_entry = -INF;
+        y_exit  =  INF;
+    } else {
+        return 1.0f;
+    }
+
+    const float entry { std::max(x_entry, y_entry) };
+    const float exit  { std::min(x_exit,  y_exit)  };
+    // entry < 0: overlapping already (moving out), do not flip again
+    if (entry > exit || entry < 0.0f || entry > 1.0f) return 1.0f;
+
+    if (x_entry > y_entry) normal_x = dx > 0.0f ? -1.0f : 1.0f;
+    else                   normal_y = dy > 0.0f ? -1.0f : 1.0f;
+    return entry;
+}
+
+void StepBall(SDL_FRect& ball, float& vx, float& vy, const SDL_FRect& p1, const SDL_FRect& p2, float dt) {
+    // per step: a slow tick (2 Hz) can bounce many times in a narrow gap between a paddle and a wall;
+    // only a guard against a zero-width gap, normal play never gets close
+    constexpr int MAX_BOUNCES { 64 };
+    float remaining { dt };
+
+    for (int i = 0; i < MAX_BOUNCES && remaining > 0.0f; ++i) {
+        float toi    { remaining };  // seconds until the first hit
+        bool  flip_x { false };
+        bool  flip_y { false };
+
+        auto hit = [&](float t, bool x, bool y) {
+            if (t < toi) {
+                toi = t;
+                flip_x = x;
+                flip_y = y;
+            } else if (t == toi) {
+                flip_x |= x;
+                flip_y |= y;
+            }
+        };
+
+        // window walls
+        if (vx < 0.0f) hit(ball.x / -vx, true, false);
+        if (vx > 0.0f) hit((WINDOW_WIDTH - ball.w - ball.x) / vx, true, false);
+        if (vy < 0.0f) hit(ball.y / -vy, false, true);
+        if (vy > 0.0f) hit((WINDOW_HEIGHT - ball.h - ball.y) / vy, false, true);
+
+        // paddles
+        for (const SDL_FRect* p : { &p1, &p2 }) {
+            float nx, ny;
+            const float t { SweptAABB(ball, vx * remaining, vy * remaining, *p, nx, ny) };
+            if (t < 1.0f) hit(t * remaining, nx != 0.0f, ny != 0.0f);
+        }
+
+        toi = std::max(toi, 0.0f);
+        ball.x += vx * toi;
+        ball.y += vy * toi;
+        if (flip_x) vx = -vx;
+        if (flip_y) vy = -vy;
+        remaining -= toi;
+    }
+
+    ball.x = std::clamp(ball.x, 0.0f, WINDOW_WIDTH  - ball.w);
+    ball.y = std::clamp(ball.y, 0.0f, WINDOW_HEIGHT - ball.h);
+}
+
 float Lerp(float a, float b, float t) {
     return a + (b - a) * t;
 }
@@ -293,45 +460,19 @@ void Game::Update(float dt) {
             player2_.body.y += player2_.speed * dt;
         }
 
-        // rect object left/right move 
-        if (state_mask_ & (1 << 4)) {
-            rect_object_.body.x += rect_object_.speed * dt;
-        } else {
-            rect_object_.body.x -= rect_object_.speed * dt;
-        }
-        // rect object up/down move   
-        if (state_mask_ & (1 << 5)) {
-            rect_object_.body.y += rect_object_.speed * dt;
-        } else {
-            rect_object_.body.y -= rect_object_.speed * dt;
-        }
-
         // player bound limit
         if (player1_.body.y < 0) player1_.body.y = 0;
         else if (player1_.body.y > WINDOW_HEIGHT - player1_.body.h) player1_.body.y = WINDOW_HEIGHT - player1_.body.h;
         if (player2_.body.y < 0) player2_.body.y = 0;
         else if (player2_.body.y > WINDOW_HEIGHT - player2_.body.h) player2_.body.y = WINDOW_HEIGHT - player2_.body.h;
 
-        // rect object bound limit
-        if (rect_object_.body.x < 0) {
-            rect_object_.body.x = 0;
-            state_mask_ |= (1<<4);
-        } else if (rect_object_.body.x > WINDOW_WIDTH - rect_object_.body.w) {
-            rect_object_.body.x = WINDOW_WIDTH - rect_object_.body.w;
-            state_mask_ &= ~(1<<4);
-        }
-        if (rect_object_.body.y < 0) {
-            rect_object_.body.y = 0;
-            state_mask_ |= (1<<5);
-        } else if (rect_object_.body.y > WINDOW_HEIGHT - rect_object_.body.h) {
-            rect_object_.body.y = WINDOW_HEIGHT - rect_object_.body.h;
-            state_mask_ &= ~(1<<5);
-        }
-
-        if (AABB_Collision(player1_.body, rect_object_.body)) {
-            state_mask_ |= (1<<4);
-        } else if (AABB_Collision(player2_.body, rect_object_.body)) {
-            state_mask_ &= ~(1<<4);
-        }
+        // rect object move, BIT 4/5 =1 is +x/+y direction
+        float vx { (state_mask_ & (1 << 4)) ? rect_object_.speed : -rect_object_.speed };
+        float vy { (state_mask_ & (1 << 5)) ? rect_object_.speed : -rect_object_.speed };
+        StepBall(rect_object_.body, vx, vy, player1_.body, player2_.body, dt);
+        if (vx > 0.0f) state_mask_ |= (1<<4);
+        else           state_mask_ &= ~(1<<4);
+        if (vy > 0.0f) state_mask_ |= (1<<5);
+        else           state_mask_ &= ~(1<<5);
     }
 }
@@ -0,0 +1,104 @@
+#include "latency_trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+void LatencyTracer::Enable() {
+    if (enabled_) return;
+    entries_ = std::make_unique<Entry[]>(CAPACITY);
+    ready_   = std::make_unique<std::atomic<bool>[]>(CAPACITY);
+    for (size_t i = 0; i < CAPACITY; ++i) ready_[i].store(false, std::memory_order_relaxed);
+    enabled_ = true;
+}
+
+const bool LatencyTracer::get_enabled() const { return enabled_; }
+
+uint32_t LatencyTracer::NewTraceId() {
+    if (!enabled_) return 0;
+    return next_id_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyTracer::Record(uint32_t trace_id, TraceStage stage, Tick server_tick, uint32_t server_apply_us, uint32_t server_hold_us) {
+    if (!enabled_ || trace_id == 0) return;
+
+    const size_t i { next_.fetch_add(1, std::memory_order_relaxed) };
+    if (i >= CAPACITY) return;  // full
+
+    entries_[i] = Entry { trace_id, stage, SDL_GetTicksNS() / 1000, server_tick, server_apply_us, server_hold_us };
+    ready_[i].store(true, std::memory_order_release);
+}
+
+bool LatencyTracer::DumpChromeTrace(const char* path) const {
+    if (!enabled_) return false;
+
+    // collect stages per trace
+    struct Trace {
+        Uint64 t[4] { 0, 0, 0, 0 };
+        Tick     tick      { 0 };
+        uint32_t apply_us  { 0 };
+        uint32_t hold_us   { 0 };
+    };
+    std::map<uint32_t, Trace> traces;
+    const size_t n { std::min(next_.load(std::memory_order_acquire), CAPACITY) };
+    for (size_t i = 0; i < n; ++i) {
+        if (!ready_[i].load(std::memory_order_acquire)) continue;
+        const Entry& e { entries_[i] };
+        Trace& tr { traces[e.trace_id] };
+        Uint64& t { tr.t[static_cast<int>(e.stage)] };
+        if (t != 0) continue;  // keep first, e.g. first rendered
+        t = e.t_us;
+        if (e.stage == TraceStage::kClientRecv) {
+            tr.tick     = e.server_tick;
+            tr.apply_us = e.server_apply_us;
+            tr.hold_us  = e.server_hold_us;
+        }
+    }
+
+    FILE* f { std::fopen(path, "w") };
+    if (!f) {
+        SDL_Log("open trace file failed: %s", path);
+        return false;
+    }
+
+    // one row per owner: whole input, client, network, server
+    std::fprintf(f, "{\"traceEvents\":[\n");
+    std::fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"input\"}},\n");
+    std::fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"client\"}},\n");
+    std::fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"network\"}},\n");
+    std::fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"server\"}}");
+
+    size_t complete { 0 };
+    for (const auto& [id, tr] : traces) {
+        const Uint64 sampled { tr.t[0] }, sent { tr.t[1] }, recv { tr.t[2] }, rendered { tr.t[3] };
+        if (!sampled || !sent || !recv || !rendered) continue;  // lost or still on the way
+
+        // server clock is unknown, assume both network legs take the same time
+        const Uint64 round    { recv - sent };
+        const Uint64 one_way  { round > tr.hold_us ? (round - tr.hold_us) / 2 : 0 };
+        const Uint64 srv_recv { sent + one_way };
+        const Uint64 applied  { srv_recv + tr.apply_us };
+        const Uint64 snapshot { srv_recv + tr.hold_us };
+
+        struct Span { const char* name; int tid; Uint64 from, to; };
+        const Span spans[] {
+            { "input",            0, sampled,  rendered },
+            { "wait send",        1, sampled,  sent     },
+            { "uplink",           2, sent,     srv_recv },
+            { "wait tick",        3, srv_recv, applied  },
+            { "tick to snapshot", 3, applied,  snapshot },
+            { "downlink",         2, snapshot, recv     },
+            { "wait render",      1, recv,     rendered },
+        };
+        for (const Span& s : spans) {
+            std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu,\"args\":{\"trace\":%u,\"tick\":%u}}",
+                         s.name, s.tid, static_cast<unsigned long long>(s.from),
+                         static_cast<unsigned long long>(s.to > s.from ? s.to - s.from : 0), id, tr.tick);
+        }
+        complete++;
+    }
+    std::fprintf(f, "\n]}\n");
+    std::fclose(f);
+
+    SDL_Log("latency trace: %zu of %zu inputs complete, written to %s", complete, traces.size(), path);
+    return true;
+}
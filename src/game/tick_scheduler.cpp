@@ -0,0 +1,62 @@
+#include "tick_scheduler.h"
+#include <algorithm>
+
+RoomRate RoomSchedule::rate() const {
+    return idle ? IDLE_RATE : RATE_LEVELS[level];
+}
+
+void RoomSchedule::set_idle(bool is_idle, Uint64 now_ns) {
+    if (idle == is_idle) return;
+    idle = is_idle;
+    if (!idle) next_tick_ns = next_snapshot_ns = now_ns;
+}
+
+static bool Due(Uint64& next_ns, float hz, Uint64 now_ns) {
+    if (now_ns < next_ns) return false;
+    const Uint64 period { static_cast<Uint64>(SDL_NS_PER_SECOND / hz) };
+    next_ns += period;
+    if (next_ns <= now_ns) next_ns = now_ns + period;
+    return true;
+}
+
+bool RoomSchedule::TickDue(Uint64 now_ns)     { return Due(next_tick_ns, rate().tick_hz, now_ns); }
+bool RoomSchedule::SnapshotDue(Uint64 now_ns) { return Due(next_snapshot_ns, rate().snapshot_hz, now_ns); }
+Uint64 RoomSchedule::NextDue() const          { return std::min(next_tick_ns, next_snapshot_ns); }
+
+TickScheduler::TickScheduler(float budget) : budget_(budget) {}
+
+void TickScheduler::AddWork(Uint64 ns) { work_ns_ += ns; }
+
+const float TickScheduler::get_load() const { return load_; }
+
+void TickScheduler::Update(Uint64 now_ns, const std::vector<RoomSchedule*>& rooms) {
+    if (window_start_ == 0) window_start_ = now_ns;
+    if (now_ns - window_start_ < CONTROL_PERIOD_NS) return;
+
+    load_ = static_cast<float>(work_ns_) / static_cast<float>(now_ns - window_start_);
+    work_ns_      = 0;
+    window_start_ = now_ns;
+
+    const bool degrade { load_ > budget_ };
+    const bool recover { load_ < budget_ * 0.6f };  // hysteresis, do not flap around the budget
+    if (!degrade && !recover) return;
+
+    std::vector<RoomSchedule*> active;
+    for (RoomSchedule* r : rooms) {
+        if (!r->idle) active.push_back(r);
+    }
+    if (active.empty()) return;
+
+    // degrade the best served rooms first, recover the worst served first: keep rooms on close levels
+    std::stable_sort(active.begin(), active.end(), [degrade](const RoomSchedule* a, const RoomSchedule* b) {
+        return degrade ? a->level < b->level : a->level > b->level;
+    });
+    size_t budget_rooms { std::max<size_t>(1, active.size() / 4) };
+    for (RoomSchedule* r : active) {
+        if (budget_rooms == 0) break;
+        const int level { std::clamp(r->level + (degrade ? 1 : -1), 0, RATE_LEVEL_COUNT - 1) };
+        if (level == r->level) continue;
+        r->level = level;
+        budget_rooms--;
+    }
+}
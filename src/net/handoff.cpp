@@ -0,0 +1,222 @@
+#include "handoff.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+constexpr int    HANDOFF_TIMEOUT_MS  { 2000 };  // each side gives up on a silent peer after
+constexpr size_t HANDOFF_FDS_PER_MSG { 250 };   // kernel takes at most 253 fds per message
+constexpr char   HANDOFF_ACK         { 'K' };   // new server has every fd
+
+// abstract unix socket name, nothing on disk to clean up
+static socklen_t HandoffAddress(int port, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    const int n { std::snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "pongnet-handoff-%d", port) };
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + n);
+}
+
+static void CloseFd(int& fd) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+}
+
+// blocking from here, but never longer than the timeout
+static void SetBlockingWithTimeout(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    const timeval tv { HANDOFF_TIMEOUT_MS / 1000, (HANDOFF_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static bool SendAll(int fd, const void* data, size_t size) {
+    auto* p { static_cast<const uint8_t*>(data) };
+    while (size > 0) {
+        const ssize_t r { send(fd, p, size, MSG_NOSIGNAL) };
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p    += r;
+        size -= static_cast<size_t>(r);
+    }
+    return true;
+}
+
+static bool RecvAll(int fd, void* data, size_t size) {
+    auto* p { static_cast<uint8_t*>(data) };
+    while (size > 0) {
+        const ssize_t r { recv(fd, p, size, 0) };
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p    += r;
+        size -= static_cast<size_t>(r);
+    }
+    return true;
+}
+
+static bool SendFds(int fd, const int* fds, size_t count) {
+    char byte { 'F' };
+    iovec iov { &byte, 1 };
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(HANDOFF_FDS_PER_MSG * sizeof(int))] {};
+    msghdr msg {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrl;
+    msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    cmsghdr* c { CMSG_FIRSTHDR(&msg) };
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type  = SCM_RIGHTS;
+    c->cmsg_len   = CMSG_LEN(count * sizeof(int));
+    std::memcpy(CMSG_DATA(c), fds, count * sizeof(int));
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == 1;
+}
+
+// append the fds of one message, false if the peer is gone or fds were cut off
+static bool RecvFds(int fd, std::vector<int>& fds) {
+    char byte;
+    iovec iov { &byte, 1 };
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(HANDOFF_FDS_PER_MSG * sizeof(int))] {};
+    msghdr msg {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    const ssize_t r { recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) };
+    if (r != 1) return false;
+
+    for (cmsghdr* c { CMSG_FIRSTHDR(&msg) }; c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        const size_t count { (c->cmsg_len - CMSG_LEN(0)) / sizeof(int) };
+        for (size_t i = 0; i < count; ++i) {
+            int got;
+            std::memcpy(&got, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            fds.push_back(got);
+        }
+    }
+    return !(msg.msg_flags & MSG_CTRUNC);
+}
+
+static int ListenFd(int port) {
+    const int fd { socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) };
+    sockaddr_un addr;
+    const socklen_t len { HandoffAddress(port, addr) };
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 || listen(fd, 1) != 0) {
+        SDL_Log("handoff: listen failed: %s", std::strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+HandoffListener::~HandoffListener() {
+    CloseFd(listen_fd_);
+    CloseFd(peer_fd_);
+}
+
+std::unique_ptr<HandoffListener> HandoffListener::Listen(int port, uint32_t version) {
+    std::unique_ptr<HandoffListener> l { new HandoffListener() };
+    l->port_      = port;
+    l->version_   = version;
+    l->listen_fd_ = ListenFd(port);
+    if (l->listen_fd_ < 0) return nullptr;
+    return l;
+}
+
+bool HandoffListener::Requested() {
+    if (peer_fd_ < 0) {
+        if (listen_fd_ < 0) return false;
+        peer_fd_ = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (peer_fd_ < 0) return false;
+        peer_since_ms_ = SDL_GetTicks();
+    }
+
+    uint32_t version { 0 };
+    const ssize_t r { recv(peer_fd_, &version, sizeof(version), MSG_DONTWAIT) };
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && SDL_GetTicks() - peer_since_ms_ < HANDOFF_TIMEOUT_MS) return false;
+    if (r != sizeof(version) || version != version_) {
+        SDL_Log("handoff: refused a new server of version %u, this one is %u", r == sizeof(version) ? version : 0, version_);
+        CloseFd(peer_fd_);
+        return false;
+    }
+
+    // one handoff only, the new server listens here once it took over
+    CloseFd(listen_fd_);
+    return true;
+}
+
+bool HandoffListener::Send(const std::vector<uint8_t>& state, const std::vector<int>& fds) {
+    SetBlockingWithTimeout(peer_fd_);
+    const uint32_t header[2] { static_cast<uint32_t>(state.size()), static_cast<uint32_t>(fds.size()) };
+    bool ok { SendAll(peer_fd_, header, sizeof(header)) && SendAll(peer_fd_, state.data(), state.size()) };
+    for (size_t at = 0; ok && at < fds.size(); at += HANDOFF_FDS_PER_MSG) {
+        ok = SendFds(peer_fd_, fds.data() + at, std::min(HANDOFF_FDS_PER_MSG, fds.size() - at));
+    }
+    char ack { 0 };
+    ok = ok && RecvAll(peer_fd_, &ack, 1) && ack == HANDOFF_ACK;
+    CloseFd(peer_fd_);
+
+    if (!ok) {
+        SDL_Log("handoff: new server did not take over, keep serving");
+        listen_fd_ = ListenFd(port_);
+    }
+    return ok;
+}
+
+bool RequestHandoff(int port, uint32_t version, std::vector<uint8_t>& state, std::vector<int>& fds) {
+    int fd { socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+    sockaddr_un addr;
+    const socklen_t len { HandoffAddress(port, addr) };
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+        SDL_Log("handoff: no running server on %d to take over", port);
+        CloseFd(fd);
+        return false;
+    }
+    SetBlockingWithTimeout(fd);
+
+    uint32_t header[2] { 0, 0 };
+    bool ok { SendAll(fd, &version, sizeof(version)) && RecvAll(fd, header, sizeof(header)) };
+    if (!ok) SDL_Log("handoff: running server refused (not version %u) or did not answer", version);
+
+    state.resize(ok ? header[0] : 0);
+    ok = ok && RecvAll(fd, state.data(), state.size());
+    fds.clear();
+    while (ok && fds.size() < header[1]) ok = RecvFds(fd, fds);
+    ok = ok && fds.size() == header[1] && SendAll(fd, &HANDOFF_ACK, 1);
+    CloseFd(fd);
+
+    if (!ok) {
+        for (int& f : fds) CloseFd(f);
+        fds.clear();
+        state.clear();
+    }
+    return ok;
+}
+
+void CloseHandedFds(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+#else  // no fd passing, deploys restart the server
+
+HandoffListener::~HandoffListener() {}
+std::unique_ptr<HandoffListener> HandoffListener::Listen(int, uint32_t) { return nullptr; }
+bool HandoffListener::Requested() { return false; }
+bool HandoffListener::Send(const std::vector<uint8_t>&, const std::vector<int>&) { return false; }
+
+bool RequestHandoff(int, uint32_t, std::vector<uint8_t>&, std::vector<int>&) {
+    SDL_Log("handoff: not supported on this platform");
+    return false;
+}
+
+void CloseHandedFds(const std::vector<int>&) {}
+
+#endif
@@ -0,0 +1,108 @@
+#include "net_sim.h"
+#include <algorithm>
+#include <sstream>
+
+bool ParseNetSimProfile(const std::string& spec, NetSimProfile& out) {
+    std::stringstream ss(spec);
+    std::string item;
+    bool first { true };
+
+    while (std::getline(ss, item, ',')) {
+        const size_t eq { item.find('=') };
+        if (eq == std::string::npos) {
+            if (!first) return false;
+            // delay, jitter, loss, duplicate, reorder
+            if      (item == "off")    out = NetSimProfile { };
+            else if (item == "lan")    out = NetSimProfile { 2,   1,  0.0f,  0.0f,  0.0f };
+            else if (item == "wifi")   out = NetSimProfile { 15,  10, 0.01f, 0.0f,  0.0f };
+            else if (item == "mobile") out = NetSimProfile { 60,  30, 0.03f, 0.01f, 0.02f };
+            else if (item == "bad")    out = NetSimProfile { 150, 80, 0.10f, 0.03f, 0.05f };
+            else return false;
+        } else {
+            const std::string key   { item.substr(0, eq) };
+            const std::string value { item.substr(eq + 1) };
+            try {
+                if      (key == "delay")   out.delay_ms  = static_cast<uint32_t>(std::stoul(value));
+                else if (key == "jitter")  out.jitter_ms = static_cast<uint32_t>(std::stoul(value));
+                else if (key == "loss")    out.loss      = std::stof(value);
+                else if (key == "dup")     out.duplicate = std::stof(value);
+                else if (key == "reorder") out.reorder   = std::stof(value);
+                else if (key == "seed")    out.seed      = static_cast<uint32_t>(std::stoul(value));
+                else return false;
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
+        first = false;
+    }
+    return true;
+}
+
+NetSim::NetSim(const NetSimProfile& profile) : profile_(profile) {}
+
+// connections are numbered in the order they first send, the same for every run with the same seed
+NetSim::Link& NetSim::FindLink(const void* conn) {
+    auto it { std::find_if(links_.begin(), links_.end(), [conn](const Link& l) { return l.conn == conn; }) };
+    if (it != links_.end()) return *it;
+
+    std::seed_seq seq { profile_.seed, links_made_++ };
+    return links_.emplace_back(Link { conn, std::mt19937(seq), 0 });
+}
+
+bool NetSim::Roll(std::mt19937& rng, float probability) {
+    return probability > 0.0f && std::uniform_real_distribution<float>(0.0f, 1.0f)(rng) < probability;
+}
+
+Uint64 NetSim::Delay(std::mt19937& rng) const {
+    if (profile_.jitter_ms == 0) return profile_.delay_ms;
+    const int j { static_cast<int>(profile_.jitter_ms) };
+    const int d { static_cast<int>(profile_.delay_ms) + std::uniform_int_distribution<int>(-j, j)(rng) };
+    return static_cast<Uint64>(std::max(d, 0));
+}
+
+void NetSim::Push(const void* conn, const void* data, int size, Uint64 now_ms) {
+    sent_++;
+    Link& link { FindLink(conn) };
+    if (Roll(link.rng, profile_.loss)) {
+        dropped_++;
+        return;
+    }
+
+    const int copies { Roll(link.rng, profile_.duplicate) ? 2 : 1 };
+    duplicated_ += copies - 1;
+    for (int c = 0; c < copies; ++c) {
+        Uint64 due { now_ms + Delay(link.rng) };
+        if (Roll(link.rng, profile_.reorder)) {
+            reordered_++;  // free to overtake, do not hold back later messages either
+        } else {
+            due = std::max(due, link.last_due);  // jitter alone keeps order, like a real stream
+            link.last_due = due;
+        }
+
+        auto* bytes { static_cast<const uint8_t*>(data) };
+        queue_.push_back(Pending { due, order_++, conn, std::vector<uint8_t>(bytes, bytes + size) });
+    }
+}
+
+void NetSim::Pump(Uint64 now_ms, const Deliver& deliver) {
+    auto due_end { std::partition(queue_.begin(), queue_.end(), [now_ms](const Pending& p) { return p.due_ms <= now_ms; }) };
+    if (due_end == queue_.begin()) return;
+
+    std::vector<Pending> ready(std::make_move_iterator(queue_.begin()), std::make_move_iterator(due_end));
+    queue_.erase(queue_.begin(), due_end);
+    std::sort(ready.begin(), ready.end(), [](const Pending& a, const Pending& b) {
+        return a.due_ms != b.due_ms ? a.due_ms < b.due_ms : a.order < b.order;
+    });
+    for (const Pending& p : ready) deliver(p.conn, p.data.data(), static_cast<int>(p.data.size()));
+}
+
+void NetSim::Forget(const void* conn) {
+    queue_.erase(std::remove_if(queue_.begin(), queue_.end(), [conn](const Pending& p) { return p.conn == conn; }), queue_.end());
+    links_.erase(std::remove_if(links_.begin(), links_.end(), [conn](const Link& l) { return l.conn == conn; }), links_.end());
+}
+
+void NetSim::LogStats(const char* direction) const {
+    SDL_Log("netsim %s: %llu messages, %llu dropped, %llu duplicated, %llu reordered", direction,
+            static_cast<unsigned long long>(sent_), static_cast<unsigned long long>(dropped_),
+            static_cast<unsigned long long>(duplicated_), static_cast<unsigned long long>(reordered_));
+}
@@ -1,4 +1,5 @@
 #include "network_manager.h"
+#include <algorithm>
 
 NetworkManager::NetworkManager() {
     running_ = true;
@@ -6,6 +7,8 @@ NetworkManager::NetworkManager() {
         SDL_Log("NET_Init failed: %s", SDL_GetError());
         running_ = false;
     }
+
+    if (const char* spec { SDL_getenv("PONGNET_NETSIM") }) EnableNetSim(spec);
 }
 
 NetworkManager::~NetworkManager() {
@@ -14,17 +17,20 @@ NetworkManager::~NetworkManager() {
         client_receive_thread_.join();  // >= c++11, you can use std::jthread since c++20
     }
 
-    if (client_socket_) {
-        NET_DestroyStreamSocket(client_socket_);
-        client_socket_ = nullptr;
-    }
+    if (sim_out_) sim_out_->LogStats("out");
+    if (sim_in_)  sim_in_->LogStats("in");
+
+    CloseServerConnection();
 
     for (auto& c: clients_) {
-        if (c) {
-            NET_DestroyStreamSocket(c);
-            c = nullptr;
+        if (c.tcp) {
+            NET_DestroyStreamSocket(c.tcp);
+            c.tcp = nullptr;
         }
     }
+    clients_.clear();
+    tcp_listener_.reset();
+    shm_listener_.reset();
 
     if (server_socket_) {
         NET_DestroyServer(server_socket_);
@@ -34,118 +40,399 @@ NetworkManager::~NetworkManager() {
     NET_Quit();
 }
 
-bool NetworkManager::ConnectToServer(const char* ip, int port) {
-    if (!running_) return false;  // init failed
-    running_ = false;
-
-    NET_Address* address = NET_ResolveHostname(ip);
+NET_StreamSocket* NetworkManager::TryConnect(const std::string& ip, int port) {
+    NET_Address* address = NET_ResolveHostname(ip.c_str());
     if (!address) {
         SDL_Log("Resolve hostname failed: %s", SDL_GetError());
-        return false;
+        return nullptr;
     }
 
-    if (NET_WaitUntilResolved(address, -1) != NET_SUCCESS) {
+    // wait in short slices, so destructor does not hang on a slow network
+    NET_Status status { NET_WAITING };
+    while (running_ && status == NET_WAITING) status = NET_WaitUntilResolved(address, 100);
+    if (status != NET_SUCCESS) {
         NET_UnrefAddress(address);
-        return false;
+        return nullptr;
     }
 
-    client_socket_ = NET_CreateClient(address, port);
+    NET_StreamSocket* sock = NET_CreateClient(address, port);
     NET_UnrefAddress(address);
-    if (!client_socket_) {
+    if (!sock) {
         SDL_Log("Create socket failed: %s", SDL_GetError());
-        return false;
+        return nullptr;
     }
 
     SDL_Log("connecting...");
-    if (NET_WaitUntilConnected(client_socket_, 2000) != NET_SUCCESS) {
+    const Uint64 start { SDL_GetTicks() };
+    status = NET_WAITING;
+    while (running_ && status == NET_WAITING && SDL_GetTicks() - start < 2000) {
+        status = NET_WaitUntilConnected(sock, 100);
+    }
+    if (status != NET_SUCCESS) {
         SDL_Log("connect to server failed!");
-        NET_DestroyStreamSocket(client_socket_);
-        client_socket_ = nullptr;
-        return false;
+        NET_DestroyStreamSocket(sock);
+        return nullptr;
     }
 
     SDL_Log("connect to server success!");
-    running_ = true;
-    client_receive_thread_ = std::thread(&NetworkManager::ClientReceiveLoop, this);
+    return sock;
+}
+
+Connection NetworkManager::Connect(const std::string& ip, int port, Transport transport) {
+    Connection c;
+    if (transport == Transport::kShm) {
+        c.shm = ShmChannel::Connect(port);
+        if (c.shm) SDL_Log("connect to local server (shm) success!");
+    } else {
+        c.tcp = TryConnect(ip, port);
+    }
+    return c;
+}
+
+bool NetworkManager::ConnectToServer(const char* ip, int port, Transport transport) {
+    if (!running_ || client_active_) return false;  // init failed or already connected
+    if (client_receive_thread_.joinable()) client_receive_thread_.join();  // lost the server before, thread is done
+
+    Connection c { Connect(ip, port, transport) };
+    if (!c) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        server_conn_ = std::move(c);
+    }
+    client_active_ = true;
+    client_receive_thread_ = std::thread([this]() {
+        ClientReceiveLoop();
+        CloseServerConnection();
+        client_active_ = false;
+    });
 
     return true;
 }
 
+bool NetworkManager::ConnectToServerAsync(const char* ip, int port, int max_attempts, Transport transport, bool reconnect) {
+    if (!running_ || client_active_) return false;  // init failed or already connecting
+    if (client_receive_thread_.joinable()) client_receive_thread_.join();  // gave up or lost the server before, thread is done
+
+    client_active_ = true;
+    client_receive_thread_ = std::thread([this, host = std::string(ip), port, max_attempts, transport, reconnect]() {
+        do {
+            const Uint64 start { SDL_GetTicks() };
+            Uint32 backoff_ms { 250 };
+            Connection c;
+
+            for (int attempt = 1; running_ && attempt <= max_attempts; ++attempt) {
+                c = Connect(host, port, transport);
+                if (c || attempt == max_attempts) break;
+
+                SDL_Log("retry connecting in %u ms (%d/%d)", backoff_ms, attempt, max_attempts);
+                for (Uint32 waited = 0; running_ && waited < backoff_ms; waited += 50) SDL_Delay(50);
+                backoff_ms = std::min<Uint32>(backoff_ms * 2, 4000);
+            }
+
+            SDL_Log("connect %s after %llu ms", c ? "done" : "given up", static_cast<unsigned long long>(SDL_GetTicks() - start));
+            if (!c) {
+                if (HandleConnectResultCallback) HandleConnectResultCallback(false);
+                break;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                server_conn_ = std::move(c);
+            }
+            if (HandleConnectResultCallback) HandleConnectResultCallback(true);
+            ClientReceiveLoop();
+            CloseServerConnection();
+            if (reconnect && running_) SDL_Log("reconnecting...");
+        } while (reconnect && running_);
+
+        client_active_ = false;
+    });
+
+    return true;
+}
+
+void NetworkManager::CloseServerConnection() {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!server_conn_) return;
+    ForgetNetSim(server_conn_.key());
+    if (server_conn_.tcp) NET_DestroyStreamSocket(server_conn_.tcp);
+    server_conn_ = Connection {};
+}
+
 void NetworkManager::ClientReceiveLoop() {
     char buf[1024];
+    const Deliver deliver { [this](const void*, const void* data, int size) {
+        if (HandleReceivedDataCallback) HandleReceivedDataCallback(data, size);
+    } };
 
     while (running_) {
-        void* s[1] { client_socket_ };
-        // wait new connection
-        if (NET_WaitUntilInputAvailable(s, 1, 0) > 0) {
-            int r { NET_ReadFromStreamSocket(client_socket_, buf, sizeof(buf)) };
-            if (r > 0) {
-                if (HandleReceivedDataCallback) HandleReceivedDataCallback(buf, r);
-            }
+        // wait new message, wake up often when simulated messages are waiting
+        const int timeout_ms { sim_in_ || sim_out_ ? 1 : 100 };
+        int r { 0 };
+        if (server_conn_.shm) {
+            server_conn_.shm->WaitReadable(timeout_ms);
+            r = server_conn_.shm->Read(buf, sizeof(buf));
+        } else {
+            void* s[1] { server_conn_.tcp };
+            if (NET_WaitUntilInputAvailable(s, 1, timeout_ms) > 0) r = NET_ReadFromStreamSocket(server_conn_.tcp, buf, sizeof(buf));
+        }
+
+        if (r > 0) {
+            ReceiveIn(server_conn_.key(), buf, r, deliver);
+        } else if (r < 0) {
+            SDL_Log("lost connection to server.");
+            if (HandleServerDisconnectedCallback) HandleServerDisconnectedCallback();
+            break;
+        }
+
+        if (sim_in_) sim_in_->Pump(SDL_GetTicks(), deliver);
+        if (sim_out_) {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            PumpOut();
         }
     }
 }
 
 bool NetworkManager::SendToServer(const void* data, int size) {
-    if (!client_socket_) return false;
     std::lock_guard<std::mutex> lock(send_mutex_);
-    return NET_WriteToStreamSocket(client_socket_, data, size) == size; 
+    if (!server_conn_) return false;
+    return WriteOut(server_conn_, data, size);
+}
+
+bool NetworkManager::EnableNetSim(const std::string& spec) {
+    NetSimProfile profile;
+    if (!ParseNetSimProfile(spec, profile)) {
+        SDL_Log("bad netsim spec: %s", spec.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    sim_out_ = std::make_unique<NetSim>(profile);
+    profile.seed += 1;
+    sim_in_  = std::make_unique<NetSim>(profile);
+    SDL_Log("netsim on: delay %u +- %u ms, loss %.3f, dup %.3f, reorder %.3f, seed %u",
+            profile.delay_ms, profile.jitter_ms, profile.loss, profile.duplicate, profile.reorder, profile.seed - 1);
+    return true;
+}
+
+bool NetworkManager::RawWrite(const Connection& c, const void* data, int size) {
+    if (c.shm)    return c.shm->Write(data, size);
+    if (c.tcp_fd) return c.tcp_fd->Write(data, size);
+    return NET_WriteToStreamSocket(c.tcp, data, size);
+}
+
+Connection* NetworkManager::FindConnection(const void* key) {
+    if (server_conn_ && server_conn_.key() == key) return &server_conn_;
+    auto it { std::find_if(clients_.begin(), clients_.end(), [key](const Connection& c) { return c.key() == key; }) };
+    return it != clients_.end() ? &*it : nullptr;
+}
+
+bool NetworkManager::WriteOut(const Connection& c, const void* data, int size) {
+    if (!sim_out_) return RawWrite(c, data, size);
+
+    sim_out_->Push(c.key(), data, size, SDL_GetTicks());
+    PumpOut();  // zero delay goes out now
+    return true;
+}
+
+void NetworkManager::PumpOut() {
+    if (!sim_out_) return;
+    sim_out_->Pump(SDL_GetTicks(), [this](const void* key, const void* data, int size) {
+        if (Connection* c { FindConnection(key) }) RawWrite(*c, data, size);
+    });
+}
+
+void NetworkManager::ReceiveIn(const void* key, const void* data, int size, const Deliver& deliver) {
+    if (!sim_in_ || !MessageFramer) {
+        deliver(key, data, size);
+        return;
+    }
+
+    auto it { std::find_if(sim_rx_.begin(), sim_rx_.end(), [key](const auto& e) { return e.first == key; }) };
+    if (it == sim_rx_.end()) it = sim_rx_.insert(sim_rx_.end(), { key, {} });
+    auto& rx    { it->second };
+    auto* bytes { static_cast<const uint8_t*>(data) };
+    rx.insert(rx.end(), bytes, bytes + size);
+
+    // split the stream into messages, each one gets its own fate
+    const Uint64 now { SDL_GetTicks() };
+    size_t used { 0 };
+    while (used < rx.size()) {
+        const int n { MessageFramer(rx.data() + used, static_cast<int>(rx.size() - used)) };
+        if (n <= 0) break;
+        sim_in_->Push(key, rx.data() + used, n, now);
+        used += n;
+    }
+    rx.erase(rx.begin(), rx.begin() + used);
+}
+
+void NetworkManager::ForgetNetSim(const void* key) {
+    if (sim_out_) sim_out_->Forget(key);
+    if (sim_in_)  sim_in_->Forget(key);
+    sim_rx_.erase(std::remove_if(sim_rx_.begin(), sim_rx_.end(), [key](const auto& e) { return e.first == key; }), sim_rx_.end());
 }
 
 bool NetworkManager::StartServer(int port) {
-    server_socket_ = NET_CreateServer(nullptr, port);  // nullptr <=> "0.0.0.0" <=> "127.0.0.1", bind to all interfaces
-    if (!server_socket_) {
+    // plain fds where they can be handed to a new process (hot restart), else SDL_net
+    tcp_listener_ = TcpFdListener::Listen(port);
+    if (!tcp_listener_) server_socket_ = NET_CreateServer(nullptr, port);  // nullptr <=> "0.0.0.0" <=> "127.0.0.1", bind to all interfaces
+    if (!tcp_listener_ && !server_socket_) {
         SDL_Log("Create server socket failed!");
         return false;
     }
+
+    // local clients may skip tcp
+    shm_listener_ = ShmListener::Listen(port);
+    if (shm_listener_) SDL_Log("local shm transport on");
     return true;
 }
 
 bool NetworkManager::AcceptClients() {
+    // at most one new client per call
+    Connection conn;
     NET_StreamSocket* c { nullptr };
-    if (NET_AcceptClient(server_socket_, &c)) {
-        if (c) {
-            clients_.emplace_back(c);
-            SDL_Log("new connection added!");
-            SDL_Log("now clients: %d", clients_.size());
-            return true;
-        }
+    if (tcp_listener_) {
+        conn.tcp_fd = tcp_listener_->Accept();
+    } else if (server_socket_ && NET_AcceptClient(server_socket_, &c) && c) {
+        conn.tcp = c;
+    }
+    if (!conn && shm_listener_) {
+        conn.shm = shm_listener_->Accept();
+    }
+
+    if (conn) {
+        SDL_Log("new %s connection added!", conn.shm ? "shm" : "tcp");
+        clients_.emplace_back(std::move(conn));
+        SDL_Log("now clients: %d", static_cast<int>(clients_.size()));
+        return true;
     }
 
     return false;
 }
 
 void NetworkManager::Broadcast(const void* data, int size) {
-    for (auto c : clients_)
-        NET_WriteToStreamSocket(c, data, size);
+    for (const auto& c : clients_)
+        WriteOut(c, data, size);
 }
 
 bool NetworkManager::SendToClient(int client_index, const void* data, int size) {
     if (client_index < 0 || client_index >= static_cast<int>(clients_.size())) return false;
-    return NET_WriteToStreamSocket(clients_[client_index], data, size) == size;
+    return WriteOut(clients_[client_index], data, size);
 }
 
 void NetworkManager::PollClients(std::function<void(int, const void*, int)> callback) {
     char buf[1024];
+    // simulated messages keep the connection key, find where the client is now
+    const Deliver deliver { [this, &callback](const void* key, const void* data, int size) {
+        auto it { std::find_if(clients_.begin(), clients_.end(), [key](const Connection& c) { return c.key() == key; }) };
+        if (it != clients_.end()) callback(static_cast<int>(it - clients_.begin()), data, size);
+    } };
+
+    PumpOut();
 
-    for (int i = 0; i < clients_.size(); ++i) {
-        void* s[1] { clients_[i] };
-
-        if (NET_WaitUntilInputAvailable(s, 1, 0) > 0) {
-            int r { NET_ReadFromStreamSocket(clients_[i], buf, sizeof(buf)) };
-            if (r <= 0) {
-                NET_DestroyStreamSocket(clients_[i]);
-                clients_.erase(clients_.begin() + i);
-                SDL_Log("a client disconnected.");
-                if (HandleClientDisconnectedCallback) HandleClientDisconnectedCallback(i);
-                i--;
-            } else {
-                callback(i, buf, r);
+    for (int i = 0; i < static_cast<int>(clients_.size()); ++i) {
+        Connection& c { clients_[i] };
+        int r { 0 };  // > 0 data, 0 nothing, < 0 gone
+        if (c.shm) {
+            r = c.shm->Read(buf, sizeof(buf));
+        } else if (c.tcp_fd) {
+            r = c.tcp_fd->Read(buf, sizeof(buf));
+        } else {
+            void* s[1] { c.tcp };
+            if (NET_WaitUntilInputAvailable(s, 1, 0) > 0) {
+                r = NET_ReadFromStreamSocket(c.tcp, buf, sizeof(buf));
+                if (r == 0) r = -1;  // readable but empty: closed
             }
         }
+
+        if (r < 0) {
+            SDL_Log("a client disconnected.");
+            DisconnectClient(i);
+            i--;
+        } else if (r > 0) {
+            ReceiveIn(c.key(), buf, r, deliver);
+        }
     }
+
+    if (sim_in_) sim_in_->Pump(SDL_GetTicks(), deliver);
+}
+
+void NetworkManager::DisconnectClient(int client_index) {
+    Connection& c { clients_[client_index] };
+    ForgetNetSim(c.key());
+    if (c.tcp) NET_DestroyStreamSocket(c.tcp);
+    clients_.erase(clients_.begin() + client_index);
+    if (HandleClientDisconnectedCallback) HandleClientDisconnectedCallback(client_index);
 }
 
 const Clients& NetworkManager::get_clients() const {
     return clients_;
 }
+
+bool NetworkManager::ExportSockets(SocketHandoff& out) {
+    if (server_socket_) return false;
+
+    out = SocketHandoff {};
+    if (tcp_listener_) {
+        out.has_tcp_listener = true;
+        out.fds.push_back(tcp_listener_->get_fd());
+    }
+    if (shm_listener_) {
+        out.has_shm_listener = true;
+        out.fds.push_back(shm_listener_->get_fd());
+    }
+    for (const Connection& c : clients_) {
+        if (c.tcp_fd) {
+            out.client_transports.push_back(Transport::kTcp);
+            out.client_unsent.push_back(c.tcp_fd->get_unsent());
+            out.fds.push_back(c.tcp_fd->get_fd());
+        } else if (c.shm) {
+            int fds[SHM_CHANNEL_FDS];
+            c.shm->get_fds(fds);
+            out.client_transports.push_back(Transport::kShm);
+            out.client_unsent.emplace_back();
+            out.fds.insert(out.fds.end(), fds, fds + SHM_CHANNEL_FDS);
+        } else {
+            return false;
+        }
+    }
+    if (sim_out_ || sim_in_) SDL_Log("netsim: messages it still holds are not handed over");
+    return true;
+}
+
+bool NetworkManager::AdoptSockets(const SocketHandoff& in, std::vector<bool>& adopted) {
+    size_t want { static_cast<size_t>(in.has_tcp_listener) + static_cast<size_t>(in.has_shm_listener) };
+    for (Transport t : in.client_transports) want += t == Transport::kShm ? SHM_CHANNEL_FDS : 1;
+    if (in.fds.size() != want || in.client_unsent.size() != in.client_transports.size()) {
+        SDL_Log("handoff: %d fds for %d expected", static_cast<int>(in.fds.size()), static_cast<int>(want));
+        return false;
+    }
+
+    size_t at { 0 };
+    if (in.has_tcp_listener) tcp_listener_ = TcpFdListener::Adopt(in.fds[at++]);
+    if (in.has_shm_listener) shm_listener_ = ShmListener::Adopt(in.fds[at++]);
+
+    adopted.assign(in.client_transports.size(), false);
+    for (size_t i = 0; i < in.client_transports.size(); ++i) {
+        Connection c;
+        if (in.client_transports[i] == Transport::kShm) {
+            int fds[SHM_CHANNEL_FDS];
+            std::copy(in.fds.begin() + at, in.fds.begin() + at + SHM_CHANNEL_FDS, fds);
+            at += SHM_CHANNEL_FDS;
+            c.shm = ShmChannel::Adopt(fds);
+        } else {
+            c.tcp_fd = TcpFdChannel::Adopt(in.fds[at++]);
+        }
+        if (!c) continue;
+
+        // the rest of a message the old server had started to send
+        const std::vector<uint8_t>& unsent { in.client_unsent[i] };
+        if (!unsent.empty()) RawWrite(c, unsent.data(), static_cast<int>(unsent.size()));
+        clients_.emplace_back(std::move(c));
+        adopted[i] = true;
+    }
+
+    SDL_Log("took over %d of %d clients", static_cast<int>(clients_.size()), static_cast<int>(in.client_transports.size()));
+    return tcp_listener_ != nullptr;
+}
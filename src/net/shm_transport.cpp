@@ -0,0 +1,326 @@
+#include "shm_transport.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ring[0]: client -> server, ring[1]: server -> client
+constexpr size_t SHM_MAP_BYTES { 2 * sizeof(ShmRing) };
+// the memfd must keep its size, or a ring access past its end kills the server (SIGBUS)
+constexpr int    SHM_SEALS     { F_SEAL_SHRINK | F_SEAL_GROW };
+constexpr Uint64 SHM_HANDSHAKE_MS { 1000 };  // connected but no fds yet, dropped after
+
+// abstract unix socket name, nothing on disk to clean up
+static socklen_t ShmAddress(int port, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    const int n { std::snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "pongnet-shm-%d", port) };
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + n);
+}
+
+static void CloseFd(int& fd) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+}
+
+ShmChannel::~ShmChannel() {
+    if (map_) munmap(map_, SHM_MAP_BYTES);
+    CloseFd(sock_fd_);
+    CloseFd(mem_fd_);
+    CloseFd(wake_self_fd_);
+    CloseFd(wake_peer_fd_);
+}
+
+bool ShmChannel::Map(int mem_fd, bool is_server) {
+    mem_fd_ = mem_fd;
+    map_ = mmap(nullptr, SHM_MAP_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd_, 0);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        return false;
+    }
+    ShmRing* rings { static_cast<ShmRing*>(map_) };
+    tx_ = is_server ? &rings[1] : &rings[0];
+    rx_ = is_server ? &rings[0] : &rings[1];
+    return true;
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Connect(int port) {
+    std::unique_ptr<ShmChannel> ch { new ShmChannel() };
+
+    const int mem_fd { memfd_create("pongnet-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING) };
+    if (mem_fd < 0 || ftruncate(mem_fd, SHM_MAP_BYTES) != 0 || fcntl(mem_fd, F_ADD_SEALS, SHM_SEALS | F_SEAL_SEAL) != 0) {
+        if (mem_fd >= 0) close(mem_fd);
+        SDL_Log("shm: memfd failed: %s", std::strerror(errno));
+        return nullptr;
+    }
+    if (!ch->Map(mem_fd, false)) return nullptr;
+    ShmRing* rings { static_cast<ShmRing*>(ch->map_) };
+    new (&rings[0]) ShmRing();
+    new (&rings[1]) ShmRing();
+
+    const int efd_server { eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) };
+    ch->wake_self_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ch->wake_peer_fd_ = efd_server;
+    if (efd_server < 0 || ch->wake_self_fd_ < 0) return nullptr;
+
+    ch->sock_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr;
+    const socklen_t len { ShmAddress(port, addr) };
+    if (ch->sock_fd_ < 0 || connect(ch->sock_fd_, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+        SDL_Log("shm: no local server on %d: %s", port, std::strerror(errno));
+        return nullptr;
+    }
+
+    // hand memfd and both eventfds to the server
+    int fds[3] { mem_fd, efd_server, ch->wake_self_fd_ };
+    char byte { 'P' };
+    iovec iov { &byte, 1 };
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(fds))] {};
+    msghdr msg {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    cmsghdr* c { CMSG_FIRSTHDR(&msg) };
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type  = SCM_RIGHTS;
+    c->cmsg_len   = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    if (sendmsg(ch->sock_fd_, &msg, MSG_NOSIGNAL) != 1) {
+        SDL_Log("shm: handshake failed: %s", std::strerror(errno));
+        return nullptr;
+    }
+
+    fcntl(ch->sock_fd_, F_SETFL, O_NONBLOCK);
+    return ch;
+}
+
+bool ShmChannel::Write(const void* data, int size) {
+    if (peer_gone_ || size <= 0) return !peer_gone_;
+
+    const uint32_t n    { static_cast<uint32_t>(size) };
+    const uint32_t head { tx_->head.load(std::memory_order_relaxed) };
+    const uint32_t tail { tx_->tail.load(std::memory_order_acquire) };
+    if (SHM_RING_BYTES - (head - tail) < n) return false;  // full
+
+    const uint32_t at    { head % SHM_RING_BYTES };
+    const uint32_t first { std::min(n, SHM_RING_BYTES - at) };
+    std::memcpy(tx_->data + at, data, first);
+    std::memcpy(tx_->data, static_cast<const uint8_t*>(data) + first, n - first);
+    tx_->head.store(head + n, std::memory_order_seq_cst);
+
+    // syscall only when the reader is really asleep
+    if (tx_->sleeping.load(std::memory_order_seq_cst)) {
+        const uint64_t one { 1 };
+        (void)!write(wake_peer_fd_, &one, sizeof(one));
+    }
+    return true;
+}
+
+int ShmChannel::Read(void* buf, int size) {
+    const uint32_t tail { rx_->tail.load(std::memory_order_relaxed) };
+    const uint32_t head { rx_->head.load(std::memory_order_acquire) };
+    const uint32_t n    { std::min(head - tail, static_cast<uint32_t>(size)) };
+
+    if (n == 0) {
+        // nothing to read: now and then check the peer is still there
+        const Uint64 now { SDL_GetTicks() };
+        if (!peer_gone_ && now - last_alive_check_ms_ >= 100) {
+            last_alive_check_ms_ = now;
+            char byte;
+            const ssize_t r { recv(sock_fd_, &byte, 1, MSG_DONTWAIT) };
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) peer_gone_ = true;
+        }
+        return peer_gone_ ? -1 : 0;
+    }
+
+    const uint32_t at    { tail % SHM_RING_BYTES };
+    const uint32_t first { std::min(n, SHM_RING_BYTES - at) };
+    std::memcpy(buf, rx_->data + at, first);
+    std::memcpy(static_cast<uint8_t*>(buf) + first, rx_->data, n - first);
+    rx_->tail.store(tail + n, std::memory_order_release);
+    return static_cast<int>(n);
+}
+
+void ShmChannel::WaitReadable(int timeout_ms) {
+    rx_->sleeping.store(1, std::memory_order_seq_cst);
+    // check again after announcing, or a write in between would not wake us
+    if (rx_->head.load(std::memory_order_seq_cst) == rx_->tail.load(std::memory_order_relaxed)) {
+        pollfd p[2] { { wake_self_fd_, POLLIN, 0 }, { sock_fd_, POLLIN, 0 } };
+        poll(p, 2, timeout_ms);
+        uint64_t v;
+        (void)!read(wake_self_fd_, &v, sizeof(v));
+    }
+    rx_->sleeping.store(0, std::memory_order_relaxed);
+}
+
+ShmListener::~ShmListener() {
+    CloseFd(listen_fd_);
+    for (Pending& p : pending_) CloseFd(p.fd);
+}
+
+std::unique_ptr<ShmListener> ShmListener::Listen(int port) {
+    std::unique_ptr<ShmListener> l { new ShmListener() };
+    l->listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_un addr;
+    const socklen_t len { ShmAddress(port, addr) };
+    if (l->listen_fd_ < 0 || bind(l->listen_fd_, reinterpret_cast<sockaddr*>(&addr), len) != 0 || listen(l->listen_fd_, 16) != 0) {
+        SDL_Log("shm: listen failed: %s", std::strerror(errno));
+        return nullptr;
+    }
+    return l;
+}
+
+// memfd from another process: map it only if it is big enough and sealed against resize
+static bool IsSafeMemFd(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < SHM_MAP_BYTES) return false;
+    const int seals { fcntl(fd, F_GET_SEALS) };
+    return seals >= 0 && (seals & SHM_SEALS) == SHM_SEALS;
+}
+
+// wake fds from another process: the server writes one whenever the client says it sleeps, so it must be
+// an eventfd (never fills up like a pipe nobody drains) and must not block
+static bool IsSafeEventFd(int fd) {
+    char path[32];
+    char link[32];
+    std::snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    const ssize_t n { readlink(path, link, sizeof(link)) };
+    if (n <= 0 || std::string_view(link, static_cast<size_t>(n)) != "anon_inode:[eventfd]") return false;
+    const int flags { fcntl(fd, F_GETFL) };
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// receive the 3 fds of the client: 1 if done, 0 if not sent yet, -1 if the client is broken
+static int ReceiveFds(int sock_fd, int (&fds)[3]) {
+    char byte;
+    iovec iov { &byte, 1 };
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(fds))] {};
+    msghdr msg {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    const ssize_t r { recvmsg(sock_fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT) };
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (r != 1) return -1;
+
+    // take every fd that came, close them all unless it is exactly ours
+    int got[3] { -1, -1, -1 };
+    size_t n { 0 };
+    for (cmsghdr* c { CMSG_FIRSTHDR(&msg) }; c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        const size_t count { (c->cmsg_len - CMSG_LEN(0)) / sizeof(int) };
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (n < 3) got[n] = fd;
+            else close(fd);
+            n++;
+        }
+    }
+    if (n != 3 || (msg.msg_flags & MSG_CTRUNC)) {
+        for (int& fd : got) CloseFd(fd);
+        return -1;
+    }
+    std::copy(got, got + 3, fds);
+    return 1;
+}
+
+std::unique_ptr<ShmChannel> ShmListener::Accept() {
+    // never wait here: a client that connects and sends nothing must not stall the server loop
+    for (int fd; (fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0;) {
+        pending_.push_back(Pending { fd, SDL_GetTicks() });
+    }
+
+    const Uint64 now { SDL_GetTicks() };
+    for (size_t i = 0; i < pending_.size();) {
+        Pending& p { pending_[i] };
+        int fds[3] { -1, -1, -1 };
+        const int r { ReceiveFds(p.fd, fds) };
+        if (r == 0 && now - p.since_ms < SHM_HANDSHAKE_MS) {
+            ++i;
+            continue;
+        }
+
+        const int fd { p.fd };
+        pending_.erase(pending_.begin() + i);
+        if (r <= 0) {
+            close(fd);
+            continue;
+        }
+
+        const int channel_fds[SHM_CHANNEL_FDS] { fd, fds[0], fds[1], fds[2] };
+        if (std::unique_ptr<ShmChannel> ch { ShmChannel::Adopt(channel_fds) }) return ch;
+    }
+    return nullptr;
+}
+
+std::unique_ptr<ShmListener> ShmListener::Adopt(int fd) {
+    std::unique_ptr<ShmListener> l { new ShmListener() };
+    l->listen_fd_ = fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return l;
+}
+
+const int ShmListener::get_fd() const { return listen_fd_; }
+
+void ShmChannel::get_fds(int (&fds)[SHM_CHANNEL_FDS]) const {
+    fds[0] = sock_fd_;
+    fds[1] = mem_fd_;
+    fds[2] = wake_self_fd_;
+    fds[3] = wake_peer_fd_;
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Adopt(const int (&fds)[SHM_CHANNEL_FDS]) {
+    // the channel owns the fds from here, closed with it if unusable
+    std::unique_ptr<ShmChannel> ch { new ShmChannel() };
+    ch->sock_fd_      = fds[0];
+    ch->wake_self_fd_ = fds[2];
+    ch->wake_peer_fd_ = fds[3];
+    if (!IsSafeMemFd(fds[1]) || !IsSafeEventFd(fds[2]) || !IsSafeEventFd(fds[3])) {
+        SDL_Log("shm: rejected a client (memfd size or seals, or wake fds not eventfds)");
+        close(fds[1]);
+        return nullptr;
+    }
+    if (!ch->Map(fds[1], true)) return nullptr;
+    return ch;
+}
+
+#else  // no memfd/eventfd, local clients use tcp
+
+ShmChannel::~ShmChannel() {}
+bool ShmChannel::Map(int, bool) { return false; }
+std::unique_ptr<ShmChannel> ShmChannel::Connect(int) {
+    SDL_Log("shm: not supported on this platform");
+    return nullptr;
+}
+bool ShmChannel::Write(const void*, int) { return false; }
+int  ShmChannel::Read(void*, int) { return -1; }
+void ShmChannel::WaitReadable(int timeout_ms) { SDL_Delay(timeout_ms); }
+
+void ShmChannel::get_fds(int (&fds)[SHM_CHANNEL_FDS]) const {
+    for (int& fd : fds) fd = -1;
+}
+std::unique_ptr<ShmChannel> ShmChannel::Adopt(const int (&)[SHM_CHANNEL_FDS]) { return nullptr; }
+
+ShmListener::~ShmListener() {}
+std::unique_ptr<ShmListener> ShmListener::Listen(int) { return nullptr; }
+std::unique_ptr<ShmListener> ShmListener::Adopt(int) { return nullptr; }
+std::unique_ptr<ShmChannel> ShmListener::Accept() { return nullptr; }
+const int ShmListener::get_fd() const { return -1; }
+
+#endif
@@ -0,0 +1,162 @@
+#include "tcp_fd.h"
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+TcpFdChannel::~TcpFdChannel() {
+    if (fd_ >= 0) close(fd_);
+}
+
+std::unique_ptr<TcpFdChannel> TcpFdChannel::Adopt(int fd) {
+    int type { 0 };
+    socklen_t len { sizeof(type) };
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) != 0 || type != SOCK_STREAM) {
+        close(fd);
+        return nullptr;
+    }
+
+    // small messages, send them at once
+    const int one { 1 };
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return std::unique_ptr<TcpFdChannel>(new TcpFdChannel(fd));
+}
+
+bool TcpFdChannel::Flush() {
+    size_t sent { 0 };
+    while (!peer_gone_ && sent < out_.size()) {
+        const ssize_t r { send(fd_, out_.data() + sent, out_.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL) };
+        if (r > 0) {
+            sent += static_cast<size_t>(r);
+        } else if (r < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) peer_gone_ = true;
+            break;
+        }
+    }
+    out_.erase(out_.begin(), out_.begin() + sent);
+    return !peer_gone_;
+}
+
+bool TcpFdChannel::Write(const void* data, int size) {
+    if (!Flush()) return false;
+    if (size <= 0) return true;
+    if (out_.size() + size > TCP_FD_QUEUE_BYTES) return false;  // peer does not read, drop whole messages
+
+    auto* bytes { static_cast<const uint8_t*>(data) };
+    out_.insert(out_.end(), bytes, bytes + size);
+    return Flush();
+}
+
+int TcpFdChannel::Read(void* buf, int size) {
+    if (!Flush()) return -1;
+
+    while (true) {
+        const ssize_t r { recv(fd_, buf, size, MSG_DONTWAIT) };
+        if (r > 0) return static_cast<int>(r);
+        if (r == 0) return -1;  // closed
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+}
+
+const int TcpFdChannel::get_fd() const { return fd_; }
+const std::vector<uint8_t>& TcpFdChannel::get_unsent() const { return out_; }
+
+TcpFdListener::~TcpFdListener() {
+    if (fd_ >= 0) close(fd_);
+}
+
+std::unique_ptr<TcpFdListener> TcpFdListener::Listen(int port) {
+    std::unique_ptr<TcpFdListener> l { new TcpFdListener() };
+    const int one  { 1 };
+    const int zero { 0 };
+
+    // ipv6 socket that also takes ipv4, plain ipv4 if the host has no ipv6
+    sockaddr_in6 addr6 {};
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port   = htons(static_cast<uint16_t>(port));
+    addr6.sin6_addr   = in6addr_any;
+    sockaddr_in addr4 {};
+    addr4.sin_family      = AF_INET;
+    addr4.sin_port        = htons(static_cast<uint16_t>(port));
+    addr4.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    l->fd_ = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (l->fd_ >= 0) {
+        setsockopt(l->fd_, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        setsockopt(l->fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(l->fd_, reinterpret_cast<sockaddr*>(&addr6), sizeof(addr6)) != 0) {
+            const int err { errno };
+            close(l->fd_);
+            l->fd_ = -1;
+            if (err == EADDRINUSE) {
+                SDL_Log("tcp: port %d is in use", port);
+                return nullptr;
+            }
+        }
+    }
+    if (l->fd_ < 0) {
+        l->fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (l->fd_ < 0) return nullptr;
+        setsockopt(l->fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(l->fd_, reinterpret_cast<sockaddr*>(&addr4), sizeof(addr4)) != 0) {
+            SDL_Log("tcp: bind %d failed: %s", port, std::strerror(errno));
+            return nullptr;
+        }
+    }
+
+    if (listen(l->fd_, 16) != 0) {
+        SDL_Log("tcp: listen failed: %s", std::strerror(errno));
+        return nullptr;
+    }
+    return l;
+}
+
+std::unique_ptr<TcpFdListener> TcpFdListener::Adopt(int fd) {
+    int listening { 0 };
+    socklen_t len { sizeof(listening) };
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) != 0 || !listening) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<TcpFdListener> l { new TcpFdListener() };
+    l->fd_ = fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return l;
+}
+
+std::unique_ptr<TcpFdChannel> TcpFdListener::Accept() {
+    const int fd { accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+    if (fd < 0) return nullptr;
+    return TcpFdChannel::Adopt(fd);
+}
+
+const int TcpFdListener::get_fd() const { return fd_; }
+
+#else  // server uses SDL_net sockets, no hot restart
+
+TcpFdChannel::~TcpFdChannel() {}
+std::unique_ptr<TcpFdChannel> TcpFdChannel::Adopt(int) { return nullptr; }
+bool TcpFdChannel::Flush() { return false; }
+bool TcpFdChannel::Write(const void*, int) { return false; }
+int  TcpFdChannel::Read(void*, int) { return -1; }
+const int TcpFdChannel::get_fd() const { return -1; }
+const std::vector<uint8_t>& TcpFdChannel::get_unsent() const { return out_; }
+
+TcpFdListener::~TcpFdListener() {}
+std::unique_ptr<TcpFdListener> TcpFdListener::Listen(int) { return nullptr; }
+std::unique_ptr<TcpFdListener> TcpFdListener::Adopt(int) { return nullptr; }
+std::unique_ptr<TcpFdChannel> TcpFdListener::Accept() { return nullptr; }
+const int TcpFdListener::get_fd() const { return -1; }
+
+#endif
@@ -0,0 +1,82 @@
+#include "network_manager.h"
+#include "protocol.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// loopback benchmark of the client transports: round trip latency and echo message rate.
+// one echo server and one client per transport in this process.
+// usage: pong_net_bench [messages]
+
+constexpr int BENCH_PORT { 9530 };
+constexpr int MSG_SIZE   { static_cast<int>(wire::Size<PlayerInputMsg>()) };
+constexpr int WINDOW     { 256 };  // messages in flight while measuring rate
+
+static void RunBench(Transport transport, int messages) {
+    const char* name { transport == Transport::kShm ? "shm" : "tcp" };
+
+    NetworkManager client;
+    std::atomic<uint64_t> echoed_bytes { 0 };
+    client.HandleReceivedDataCallback = [&echoed_bytes](const void*, int size) {
+        echoed_bytes.fetch_add(size, std::memory_order_release);
+    };
+    if (!client.ConnectToServer("127.0.0.1", BENCH_PORT, transport)) {
+        SDL_Log("%s: connect failed, skipped", name);
+        return;
+    }
+
+    PlayerInputMsg msg {};
+    const auto buf { EncodeMessage(msg) };
+    auto echoed = [&echoed_bytes]() { return echoed_bytes.load(std::memory_order_acquire) / MSG_SIZE; };
+
+    // latency: one message in flight
+    std::vector<double> rtt_us;
+    rtt_us.reserve(messages);
+    for (int i = 0; i < messages; ++i) {
+        const uint64_t want { echoed() + 1 };
+        const Uint64 t0 { SDL_GetTicksNS() };
+        client.SendToServer(buf.data(), MSG_SIZE);
+        while (echoed() < want) {}
+        rtt_us.push_back((SDL_GetTicksNS() - t0) / 1000.0);
+    }
+    std::sort(rtt_us.begin(), rtt_us.end());
+
+    // rate: keep WINDOW messages in flight
+    const uint64_t base { echoed() };
+    const Uint64 t0 { SDL_GetTicksNS() };
+    for (int sent = 0; sent < messages; ++sent) {
+        while (sent - static_cast<int>(echoed() - base) >= WINDOW) {}
+        client.SendToServer(buf.data(), MSG_SIZE);
+    }
+    while (echoed() - base < static_cast<uint64_t>(messages)) {}
+    const double secs { (SDL_GetTicksNS() - t0) / 1e9 };
+
+    SDL_Log("%s: rtt p50 %.1f us, p99 %.1f us, max %.1f us | echo rate %.0f msg/s (%d x %d bytes)",
+            name, rtt_us[rtt_us.size() / 2], rtt_us[rtt_us.size() * 99 / 100], rtt_us.back(),
+            messages / secs, messages, MSG_SIZE);
+}
+
+int main(int argc, char* argv[]) {
+    const int messages { argc > 1 ? std::max(1, std::atoi(argv[1])) : 20000 };
+
+    NetworkManager server;
+    if (!server.StartServer(BENCH_PORT)) return 1;
+
+    // echo everything back, busy polling like a loaded server
+    std::atomic<bool> server_running { true };
+    std::thread server_thread([&server, &server_running]() {
+        while (server_running) {
+            server.AcceptClients();
+            server.PollClients([&server](int index, const void* data, int size) {
+                server.SendToClient(index, data, size);
+            });
+        }
+    });
+
+    RunBench(Transport::kTcp, messages);
+    RunBench(Transport::kShm, messages);
+
+    server_running = false;
+    server_thread.join();
+    return 0;
+}
@@ -1,44 +1,97 @@
 #include "game.h"
 #include "network_manager.h"
 #include "protocol.h"
+#include <algorithm>
+#include <cstring>
 
 int main(int argc, char* argv[]) {
     Game game;
+    // stream bytes of a message split between reads; declared before nm, so it outlives the
+    // network thread (joined in ~NetworkManager) that appends to it
+    std::vector<uint8_t> rx_buf;
     NetworkManager nm;
 
+    // `--shm`: server runs on this host, talk through shared memory instead of tcp loopback
+    Transport transport { Transport::kTcp };
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--shm") == 0) transport = Transport::kShm;
+    }
+
     SDL_Log("Welcome to the PongNet!");
     SDL_Log("Use W/S or ↑/↓ arrow keys move up/down.");
 
-    bool is_connected  { nm.ConnectToServer("127.0.0.1", 9527) };
+    // online callbacks, game switches to online when InitMsg arrives
+    // send as soon as input changes (limited by server rate), heartbeat while idle
+    game.Send2ServerCallback = [&game, &nm]() -> void {
+        static uint32_t last_send = 0;
+        static uint32_t seq       = 0;
+        static uint8_t  last_mask = 0;
+        static uint8_t  prev_masks[INPUT_REDUNDANCY] {};
 
-    // set online callback
-    if (is_connected) {
-        game.set_is_online(true);
+        const InputRate rate { game.get_input_rate() };
+        const uint8_t   mask { static_cast<uint8_t>(game.get_state_mask() & 0x0F) };
+        const uint32_t  now  = SDL_GetTicks();
+        const uint32_t  idle = now - last_send;
+        const bool changed { seq == 0 || mask != last_mask };
+        if (changed ? idle < rate.min_interval_ms : idle < rate.heartbeat_ms) return;
 
-        game.Send2ServerCallback = [&game, &nm]() -> void {
-            static uint32_t last_send = SDL_GetTicks();
+        PlayerInputMsg msg;
+        msg.tick = 0;
+        msg.client_time_ms = now;
+        msg.mask = mask;
+        msg.p_id = game.get_player_id();
+        msg.seq  = ++seq;
+        std::copy(prev_masks, prev_masks + INPUT_REDUNDANCY, msg.prev_masks);
+        msg.trace_id = game.TakeInputTraceId();
 
-            uint32_t now = SDL_GetTicks();
-            if (now - last_send < 50) return; // 20Hz
+        const auto buf { EncodeMessage(msg) };
+        nm.SendToServer(buf.data(), static_cast<int>(buf.size()));
+        game.get_tracer().Record(msg.trace_id, TraceStage::kSent);
 
-            PlayerInputMsg msg;
-            msg.tick = 0;
-            msg.client_time_ms = SDL_GetTicks();
-            msg.mask = game.get_state_mask();
-            msg.p_id = game.get_player_id();
+        // shift history, newest first
+        std::copy_backward(prev_masks, prev_masks + INPUT_REDUNDANCY - 1, prev_masks + INPUT_REDUNDANCY);
+        prev_masks[0] = mask;
+        last_mask = mask;
+        last_send = now;
+    };
 
-            nm.SendToServer(&msg, sizeof(msg));
-            last_send = now;
-        };
+    // just decode messages in handle receive thread, do not set game state
+    nm.HandleReceivedDataCallback = [&game, &rx_buf](const void* data, int size) {
+        auto* bytes { static_cast<const uint8_t*>(data) };
+        rx_buf.insert(rx_buf.end(), bytes, bytes + size);
+        const size_t used { DispatchMessages(rx_buf.data(), rx_buf.size(), [&game](const auto& msg) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(msg)>, GameStateMsg>) {
+                game.get_tracer().Record(msg.echo_trace_id, TraceStage::kClientRecv, msg.trace_tick, msg.trace_apply_us, msg.trace_hold_us);
+            }
+            if constexpr (std::is_constructible_v<NetEvent, decltype(msg)>) game.AddNetEvent(NetEvent { msg });
+        }) };
+        if (used == STREAM_BROKEN) {
+            // a server this build cannot read, nothing after it can be trusted
+            SDL_Log("unknown message from server, play offline.");
+            rx_buf.clear();
+            game.OnServerLost();
+            return;
+        }
+        rx_buf.erase(rx_buf.begin(), rx_buf.begin() + used);
+    };
 
-        // just accept messages in handle receive thread, do not set game state
-        nm.HandleReceivedDataCallback = [&game](const void* data, size_t size) {
-            NetEvent ev;
-            ev.type = static_cast<MessageType>(*reinterpret_cast<const uint8_t*>(data));
-            ev.data.assign((uint8_t*)data, (uint8_t*)data + size);
-            game.AddNetEvent(ev);
-        };
-    }
+    // lets the network simulator (PONGNET_NETSIM) handle single messages
+    nm.MessageFramer = [](const void* data, int size) -> int {
+        return static_cast<int>(Messages::FrameSize(static_cast<const uint8_t*>(data), size));
+    };
+
+    nm.HandleConnectResultCallback = [](bool ok) {
+        if (!ok) SDL_Log("server unreachable, play offline.");
+    };
+
+    // play offline until reconnected, a half message of the old connection means nothing to the next one
+    nm.HandleServerDisconnectedCallback = [&game, &rx_buf]() {
+        rx_buf.clear();
+        game.OnServerLost();
+    };
+
+    // do not block the first frame on network, play offline until connected (again after a server restart)
+    nm.ConnectToServerAsync("127.0.0.1", 9527, 5, transport, true);
 
     game.Loop();
 
@@ -1,9 +1,20 @@
+#include "bot.h"
 #include "game.h"
+#include "handoff.h"
 #include "network_manager.h"
 #include "protocol.h"
+#include "tick_scheduler.h"
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
 
-constexpr float SERVER_DT    { 1.0f / 30.0f }; // 30Hz
+constexpr int       PORT       { 9527 };
+constexpr InputRate INPUT_RATE { 8, 250 };     // clients: input upload at most 125Hz, heartbeat 4Hz while idle
+constexpr Uint64 AFK_NS        { 30 * SDL_NS_PER_SECOND };  // no input change this long, room goes idle
+constexpr Uint64 MAX_WAIT_NS   { 5 * SDL_NS_PER_MS };       // sleep at most, sockets are polled in between
+constexpr int    BOT_MATCH     { -2 };  // match_player_index of a player against a bot
 
 static SDL_FRect p1_body   { 0.0f, 0.0f, PLAYER_WIDTH, PLAYER_HEIGHT };
 static SDL_FRect p2_body   { WINDOW_WIDTH - PLAYER_WIDTH, 0.0f, PLAYER_WIDTH, PLAYER_HEIGHT };
@@ -12,6 +23,7 @@ static SDL_FRect ball_body { 0.0f, 0.0f, BALL_WIDTH, BALL_HEIGHT };
 struct ServerPlayer {
     float y { (WINDOW_HEIGHT - 150.0f) / 2.0f };
     uint8_t input_mask { 0 };
+    uint8_t pending_mask { 0 };  // inputs seen since last tick, so a short tap still moves one tick
 };
 
 struct ServerBall {
@@ -32,120 +44,584 @@ struct ServerGameState {
     Tick tick;
 };
 
+// one match, ticks and sends snapshots at its own rate
+struct Room {
+    ServerGameState gs {};
+    bool   has_p1 { false };
+    bool   has_p2 { false };
+    int    bot_p1 { -1 };  // BotPool slot when a bot plays the side
+    int    bot_p2 { -1 };
+    Uint64 open_ns { 0 };        // since a player waits alone
+    Uint64 last_input_ns { 0 };  // last human input change
+    RoomSchedule schedule;
+
+    // due in this loop
+    bool ticked   { false };
+    bool snapshot { false };
+};
+
+static bool HasHuman(const Room& room) {
+    return (room.has_p1 && room.bot_p1 < 0) || (room.has_p2 && room.bot_p2 < 0);
+}
+
+// same clock in the old and the new server process (SDL ticks start at each process)
+static Uint64 MonotonicNs() {
+    using namespace std::chrono;
+    return static_cast<Uint64>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
 struct PlayerMatch {
     PlayerId id;
     int      match_player_index;
+    uint32_t room_id;
+
+    uint32_t last_input_seq  { 0 };
+    Tick     echo_client_time_ms { 0 };  // client time of the last input
+    Uint64   echo_recv_ms    { 0 };      // server time it arrived
+
+    std::vector<uint8_t> rx_buf;  // stream bytes of a message split between reads
+
+    // latency trace of one input at a time, 0 = none
+    uint32_t trace_id       { 0 };
+    Uint64   trace_recv_ns  { 0 };
+    Uint64   trace_apply_ns { 0 };
+    Tick     trace_tick     { 0 };
 };
 
-void UpdateServerGame(ServerGameState& gs) {
+void UpdateServerGame(ServerGameState& gs, float dt) {
+    const uint8_t p1_mask { static_cast<uint8_t>(gs.p1.input_mask | gs.p1.pending_mask) };
+    const uint8_t p2_mask { static_cast<uint8_t>(gs.p2.input_mask | gs.p2.pending_mask) };
+    gs.p1.pending_mask = gs.p2.pending_mask = 0;
+
     // player 1
-    if (gs.p1.input_mask & (1 << 0))
-        gs.p1.y -= PLAYER_SPEED * SERVER_DT;
-    if (gs.p1.input_mask & (1 << 1))
-        gs.p1.y += PLAYER_SPEED * SERVER_DT;
+    if (p1_mask & (1 << 0))
+        gs.p1.y -= PLAYER_SPEED * dt;
+    if (p1_mask & (1 << 1))
+        gs.p1.y += PLAYER_SPEED * dt;
 
     // player 2
-    if (gs.p2.input_mask & (1 << 2))
-        gs.p2.y -= PLAYER_SPEED * SERVER_DT;
-    if (gs.p2.input_mask & (1 << 3))
-        gs.p2.y += PLAYER_SPEED * SERVER_DT;
+    if (p2_mask & (1 << 2))
+        gs.p2.y -= PLAYER_SPEED * dt;
+    if (p2_mask & (1 << 3))
+        gs.p2.y += PLAYER_SPEED * dt;
 
     // clamp players
     gs.p1.y = std::clamp(gs.p1.y, 0.0f, WINDOW_HEIGHT - PLAYER_HEIGHT);
     gs.p2.y = std::clamp(gs.p2.y, 0.0f, WINDOW_HEIGHT - PLAYER_HEIGHT);
 
-    // ball move
-    gs.ball_x += gs.ball_vx * SERVER_DT;
-    gs.ball_y += gs.ball_vy * SERVER_DT;
-
-    // player collision
+    // ball move, continuous collision with players and walls
     p1_body.y = gs.p1.y;
     p2_body.y = gs.p2.y;
     ball_body.x = gs.ball_x;
     ball_body.y = gs.ball_y;
-    if (AABB_Collision(p1_body, ball_body)) {
-        gs.ball_vx = -gs.ball_vx;
-    } else if (AABB_Collision(p2_body, ball_body)) {
-        gs.ball_vx = -gs.ball_vx;
+    StepBall(ball_body, gs.ball_vx, gs.ball_vy, p1_body, p2_body, dt);
+    gs.ball_x = ball_body.x;
+    gs.ball_y = ball_body.y;
+
+    gs.tick++;
+}
+
+// hot restart: state records, packed like messages (wire.h) and sent along with the sockets.
+// times go as ages at release, ticks of the old process mean nothing to the new one
+constexpr uint16_t HANDOFF_STATE_VERSION { 1 };  // bump on any change of the records below
+constexpr uint32_t HANDOFF_VERSION { static_cast<uint32_t>(PROTOCOL_VERSION) << 16 | HANDOFF_STATE_VERSION };  // clients stay, so same protocol too
+
+struct HandoffHeader {
+    uint64_t release_ns;  // MonotonicNs when the old server stopped serving
+    uint32_t next_room_id;
+    uint32_t room_count;
+    uint32_t client_count;
+    uint8_t  has_tcp_listener;
+    uint8_t  has_shm_listener;
+
+    template <class Self, class F>
+    static constexpr void Fields(Self& m, F&& f) {
+        f(m.release_ns); f(m.next_room_id); f(m.room_count); f(m.client_count);
+        f(m.has_tcp_listener); f(m.has_shm_listener);
     }
+};
 
-    // wall collision
-    if (gs.ball_y < 0 || gs.ball_y > WINDOW_HEIGHT - PLAYER_WIDTH)
-        gs.ball_vy = -gs.ball_vy;
+struct RoomRecord {
+    uint32_t id;
+    float    ball_x, ball_y, ball_vx, ball_vy;
+    float    p1_y, p2_y;
+    uint8_t  p1_input_mask, p1_pending_mask, p2_input_mask, p2_pending_mask;
+    Tick     tick;
+    uint8_t  has_p1, has_p2;
+    uint8_t  bot_p1, bot_p2;  // a bot plays the side
+    uint64_t open_age_ns, input_age_ns;
+    uint8_t  level, idle;
+    int64_t  tick_in_ns, snapshot_in_ns;  // until due, < 0 overdue
 
-    if (gs.ball_x < 0 || gs.ball_x > WINDOW_WIDTH - PLAYER_WIDTH)
-        gs.ball_vx = -gs.ball_vx;
+    template <class Self, class F>
+    static constexpr void Fields(Self& m, F&& f) {
+        f(m.id); f(m.ball_x); f(m.ball_y); f(m.ball_vx); f(m.ball_vy); f(m.p1_y); f(m.p2_y);
+        f(m.p1_input_mask); f(m.p1_pending_mask); f(m.p2_input_mask); f(m.p2_pending_mask); f(m.tick);
+        f(m.has_p1); f(m.has_p2); f(m.bot_p1); f(m.bot_p2); f(m.open_age_ns); f(m.input_age_ns);
+        f(m.level); f(m.idle); f(m.tick_in_ns); f(m.snapshot_in_ns);
+    }
+};
 
-    gs.tick++;
+struct ClientRecord {
+    Transport transport;
+    PlayerId  id;
+    int32_t   match_player_index;
+    uint32_t  room_id;
+    uint32_t  last_input_seq;
+    Tick      echo_client_time_ms;
+    uint64_t  echo_age_ms;
+    uint32_t  trace_id;
+    Tick      trace_tick;
+    uint8_t   trace_applied;
+    uint64_t  trace_recv_age_ns, trace_apply_age_ns;
+    uint32_t  rx_size;      // followed by the bytes of rx_buf
+    uint32_t  unsent_size;  // then the bytes the socket did not take yet
+
+    template <class Self, class F>
+    static constexpr void Fields(Self& m, F&& f) {
+        f(m.transport); f(m.id); f(m.match_player_index); f(m.room_id); f(m.last_input_seq);
+        f(m.echo_client_time_ms); f(m.echo_age_ms); f(m.trace_id); f(m.trace_tick); f(m.trace_applied);
+        f(m.trace_recv_age_ns); f(m.trace_apply_age_ns); f(m.rx_size); f(m.unsent_size);
+    }
+};
+
+static int64_t DueIn(Uint64 due_ns, Uint64 now_ns) {
+    return static_cast<int64_t>(due_ns - now_ns);
+}
+
+// rooms with a human player and all clients; bot vs bot rooms are load of this process, not handed over
+static std::vector<uint8_t> SaveState(Uint64 release_ns, uint32_t next_room_id, const std::map<uint32_t, Room>& rooms,
+                                      const std::vector<PlayerMatch>& cs_match, const SocketHandoff& sockets) {
+    const Uint64 now    { SDL_GetTicksNS() };
+    const Uint64 now_ms { SDL_GetTicks() };
+    std::vector<uint8_t> out;
+
+    uint32_t room_count { 0 };
+    for (const auto& [id, room] : rooms) room_count += HasHuman(room) ? 1 : 0;
+    wire::Append(out, HandoffHeader { release_ns, next_room_id, room_count, static_cast<uint32_t>(cs_match.size()),
+                                      sockets.has_tcp_listener, sockets.has_shm_listener });
+
+    for (const auto& [id, room] : rooms) {
+        if (!HasHuman(room)) continue;
+        const ServerGameState& gs { room.gs };
+        wire::Append(out, RoomRecord { id, gs.ball_x, gs.ball_y, gs.ball_vx, gs.ball_vy, gs.p1.y, gs.p2.y,
+                                       gs.p1.input_mask, gs.p1.pending_mask, gs.p2.input_mask, gs.p2.pending_mask, gs.tick,
+                                       room.has_p1, room.has_p2, room.bot_p1 >= 0, room.bot_p2 >= 0,
+                                       now - room.open_ns, now - room.last_input_ns,
+                                       static_cast<uint8_t>(room.schedule.level), room.schedule.idle,
+                                       DueIn(room.schedule.next_tick_ns, now), DueIn(room.schedule.next_snapshot_ns, now) });
+    }
+
+    for (size_t i = 0; i < cs_match.size(); ++i) {
+        const PlayerMatch& m { cs_match[i] };
+        const std::vector<uint8_t>& unsent { sockets.client_unsent[i] };
+        wire::Append(out, ClientRecord { sockets.client_transports[i], m.id, m.match_player_index, m.room_id, m.last_input_seq,
+                                         m.echo_client_time_ms, now_ms - m.echo_recv_ms, m.trace_id, m.trace_tick,
+                                         m.trace_apply_ns != 0, now - m.trace_recv_ns, now - m.trace_apply_ns,
+                                         static_cast<uint32_t>(m.rx_buf.size()), static_cast<uint32_t>(unsent.size()) });
+        out.insert(out.end(), m.rx_buf.begin(), m.rx_buf.end());
+        out.insert(out.end(), unsent.begin(), unsent.end());
+    }
+    return out;
+}
+
+static bool TakeBytes(const uint8_t*& p, const uint8_t* end, uint32_t size, std::vector<uint8_t>& out) {
+    if (static_cast<size_t>(end - p) < size) return false;
+    out.assign(p, p + size);
+    p += size;
+    return true;
+}
+
+// take over the sockets and carry on with the rooms of the old server; false if the state does not parse
+// (fds are closed then). clients whose socket is unusable are dropped like a disconnect.
+static bool RestoreState(const std::vector<uint8_t>& state, const std::vector<int>& fds, NetworkManager& nm, uint32_t& next_room_id,
+                         std::map<uint32_t, Room>& rooms, std::vector<PlayerMatch>& cs_match, BotPool& bots, float bot_level,
+                         Uint64& release_ns) {
+    const uint8_t* p   { state.data() };
+    const uint8_t* end { p + state.size() };
+    HandoffHeader header {};
+    bool ok { wire::Take(p, end, header) };
+
+    // an age is counted from release, add the handover itself; the result may lie before this process
+    // started, unsigned wrap keeps every `now - t` right
+    const Uint64 now     { SDL_GetTicksNS() };
+    const Uint64 now_ms  { SDL_GetTicks() };
+    const Uint64 since   { ok ? MonotonicNs() - header.release_ns : 0 };
+    auto due_at = [now, since](int64_t in_ns) -> Uint64 {
+        return in_ns > static_cast<int64_t>(since) ? now + (in_ns - since) : now;
+    };
+
+    std::map<uint32_t, Room> taken_rooms;
+    for (uint32_t k = 0; ok && k < header.room_count; ++k) {
+        RoomRecord r {};
+        ok = wire::Take(p, end, r) && r.level < RATE_LEVEL_COUNT;
+        if (!ok) break;
+
+        Room& room { taken_rooms[r.id] };
+        ServerGameState& gs { room.gs };
+        gs.ball_x  = r.ball_x;
+        gs.ball_y  = r.ball_y;
+        gs.ball_vx = r.ball_vx;
+        gs.ball_vy = r.ball_vy;
+        gs.p1      = ServerPlayer { r.p1_y, r.p1_input_mask, r.p1_pending_mask };
+        gs.p2      = ServerPlayer { r.p2_y, r.p2_input_mask, r.p2_pending_mask };
+        gs.tick    = r.tick;
+        room.has_p1 = r.has_p1;
+        room.has_p2 = r.has_p2;
+        if (r.bot_p1) room.bot_p1 = bots.Add(PlayerId::kPlayer1, bot_level, r.id);
+        if (r.bot_p2) room.bot_p2 = bots.Add(PlayerId::kPlayer2, bot_level, r.id);
+        room.open_ns       = now - (r.open_age_ns + since);
+        room.last_input_ns = now - (r.input_age_ns + since);
+        room.schedule.level            = r.level;
+        room.schedule.idle             = r.idle;
+        room.schedule.next_tick_ns     = due_at(r.tick_in_ns);
+        room.schedule.next_snapshot_ns = due_at(r.snapshot_in_ns);
+    }
+
+    std::vector<PlayerMatch> taken_clients;
+    SocketHandoff sockets;
+    sockets.has_tcp_listener = header.has_tcp_listener;
+    sockets.has_shm_listener = header.has_shm_listener;
+    for (uint32_t k = 0; ok && k < header.client_count; ++k) {
+        ClientRecord c {};
+        PlayerMatch m { PlayerId::kPlayer1, -1, 0 };
+        std::vector<uint8_t> unsent;
+        ok = wire::Take(p, end, c) && TakeBytes(p, end, c.rx_size, m.rx_buf) && TakeBytes(p, end, c.unsent_size, unsent) &&
+             c.match_player_index < static_cast<int32_t>(header.client_count) && taken_rooms.count(c.room_id) > 0;
+        if (!ok) break;
+
+        m.id                  = c.id;
+        m.match_player_index  = c.match_player_index;
+        m.room_id             = c.room_id;
+        m.last_input_seq      = c.last_input_seq;
+        m.echo_client_time_ms = c.echo_client_time_ms;
+        m.echo_recv_ms        = now_ms - (c.echo_age_ms + since / SDL_NS_PER_MS);
+        m.trace_id            = c.trace_id;
+        m.trace_tick          = c.trace_tick;
+        m.trace_recv_ns       = now - (c.trace_recv_age_ns + since);
+        m.trace_apply_ns      = c.trace_applied ? now - (c.trace_apply_age_ns + since) : 0;
+        taken_clients.push_back(std::move(m));
+        sockets.client_transports.push_back(c.transport);
+        sockets.client_unsent.push_back(std::move(unsent));
+    }
+    ok = ok && p == end;
+
+    sockets.fds = fds;
+    std::vector<bool> adopted;
+    if (!ok || !nm.AdoptSockets(sockets, adopted)) {
+        SDL_Log("handoff: bad state from the old server");
+        CloseHandedFds(fds);
+        for (const auto& [id, room] : taken_rooms) {
+            if (room.bot_p1 >= 0) bots.Remove(room.bot_p1);
+            if (room.bot_p2 >= 0) bots.Remove(room.bot_p2);
+        }
+        return false;
+    }
+
+    next_room_id = header.next_room_id;
+    rooms        = std::move(taken_rooms);
+    cs_match     = std::move(taken_clients);
+    release_ns   = header.release_ns;
+    // highest index first, each one moves the ones after it
+    for (int i = static_cast<int>(adopted.size()) - 1; i >= 0; --i) {
+        if (!adopted[i]) nm.HandleClientDisconnectedCallback(i);
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
     NetworkManager nm;
-    
-    const bool is_server_started { nm.StartServer(9527) };
+
+    // `--takeover`: hot restart, take the port, the clients and the rooms of the server running on this host
+    bool takeover { false };
+    // bots: `--bot-wait <s>` a lone player gets a bot after s seconds (0 = never), `--bot-level <0..1>`,
+    // `--bot-rooms <n>` n bot vs bot rooms without socket, synthetic load for capacity tests
+    float bot_wait_s { 5.0f };
+    float bot_level  { 0.6f };
+    int   bot_rooms  { 0 };
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--takeover") == 0) takeover = true;
+        else if (std::strcmp(argv[i], "--bot-wait")  == 0 && i + 1 < argc) bot_wait_s = static_cast<float>(std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--bot-level") == 0 && i + 1 < argc) bot_level  = static_cast<float>(std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--bot-rooms") == 0 && i + 1 < argc) bot_rooms  = std::atoi(argv[++i]);
+    }
+
     const Clients& cs { nm.get_clients() };
     std::vector<PlayerMatch> cs_match;
     cs_match.reserve(8);
 
-    nm.HandleClientDisconnectedCallback = [&cs_match](int index) -> void {
+    // lets the network simulator (PONGNET_NETSIM) handle single messages
+    nm.MessageFramer = [](const void* data, int size) -> int {
+        return static_cast<int>(Messages::FrameSize(static_cast<const uint8_t*>(data), size));
+    };
+
+    std::map<uint32_t, Room> rooms;  // ordered, scheduler degrades them in a stable order
+    uint32_t next_room_id { 1 };
+    TickScheduler scheduler;
+    std::vector<RoomSchedule*> schedules;
+    BotPool bots;
+
+    nm.HandleClientDisconnectedCallback = [&cs_match, &rooms, &bots](int index) -> void {
         int matched_index { cs_match[index].match_player_index };
-        if (matched_index != -1) {
+        if (matched_index >= 0) {
             // someone disconnected, then matched player no friend
             cs_match[matched_index].match_player_index = -1;
         }
+
+        // free the side, the room is gone with its last player
+        auto room { rooms.find(cs_match[index].room_id) };
+        if (room != rooms.end()) {
+            Room& r { room->second };
+            (cs_match[index].id == PlayerId::kPlayer1 ? r.has_p1 : r.has_p2) = false;
+            r.open_ns = SDL_GetTicksNS();  // the one left waits again
+            if (!HasHuman(r)) {
+                // bots do not play alone
+                if (r.bot_p1 >= 0) bots.Remove(r.bot_p1);
+                if (r.bot_p2 >= 0) bots.Remove(r.bot_p2);
+                rooms.erase(room);
+            }
+        }
+
         cs_match.erase(cs_match.begin() + index);  // sync clients erase
+        for (auto& m : cs_match) {
+            if (m.match_player_index > index) m.match_player_index--;
+        }
     };
 
-    ServerGameState gs;
-    gs.tick = 0;
+    // hot restart: the old server stops after its loop and sends everything, this one resumes on its next loop
+    bool   is_server_started { false };
+    Uint64 takeover_release_ns { 0 };  // old server's release, until the first loop here
+    if (takeover) {
+        std::vector<uint8_t> state;
+        std::vector<int>     fds;
+        if (RequestHandoff(PORT, HANDOFF_VERSION, state, fds)) {
+            is_server_started = RestoreState(state, fds, nm, next_room_id, rooms, cs_match, bots, bot_level, takeover_release_ns);
+        }
+    }
+    if (!takeover_release_ns) is_server_started = nm.StartServer(PORT);
+    // the next build can take over from this one
+    std::unique_ptr<HandoffListener> handoff;
+    if (is_server_started) handoff = HandoffListener::Listen(PORT, HANDOFF_VERSION);
+
+    const Uint64 start_ns { SDL_GetTicksNS() };
+    for (int k = 0; k < bot_rooms; ++k) {
+        Room& room { rooms[next_room_id++] };
+        room.has_p1 = room.has_p2 = true;
+        room.bot_p1 = bots.Add(PlayerId::kPlayer1, bot_level, static_cast<uint32_t>(2 * k + 1));
+        room.bot_p2 = bots.Add(PlayerId::kPlayer2, bot_level, static_cast<uint32_t>(2 * k + 2));
+    }
+    if (bot_rooms > 0) SDL_Log("%d bot rooms as synthetic load", bot_rooms);
+
+    Uint64 last_report { 0 };
     while (is_server_started) {
-        // first player is p1, second p2, they are matched together
+        const Uint64 work_start { SDL_GetTicksNS() };
+
+        // a new player joins someone waiting, else opens a room as p1
         bool is_new_connection { nm.AcceptClients() };  // here emplace_back new connection client
         int  last_index { static_cast<int>(cs.size() - 1) };
-        // The client with even index is p1, and the client with odd index is p2
         if (is_new_connection) {
+            SDL_Log("clients size: %d", static_cast<int>(cs.size()));
+            PlayerMatch pm { PlayerId::kPlayer1, -1, 0 };
+            for (int i = 0; i < last_index; ++i) {
+                if (cs_match[i].match_player_index != -1) continue;
+                cs_match[i].match_player_index = last_index;
+                pm.match_player_index = i;
+                pm.id      = cs_match[i].id == PlayerId::kPlayer1 ? PlayerId::kPlayer2 : PlayerId::kPlayer1;
+                pm.room_id = cs_match[i].room_id;
+                break;
+            }
+            if (pm.match_player_index == -1) {
+                pm.room_id = next_room_id++;
+                rooms[pm.room_id].open_ns = SDL_GetTicksNS();
+            }
+            cs_match.emplace_back(pm);
+
+            Room& room { rooms[pm.room_id] };
+            (pm.id == PlayerId::kPlayer1 ? room.has_p1 : room.has_p2) = true;
+            room.last_input_ns = SDL_GetTicksNS();
+            SDL_Log("client %d: id - %d, room - %u, matched_index - %d", last_index, static_cast<int>(pm.id), pm.room_id, pm.match_player_index);
+
             InitMsg init_msg;
-            SDL_Log("clients size: %d", cs.size());
-            init_msg.tick = gs.tick;
-            init_msg.p_id = last_index%2 == 0 ? PlayerId::kPlayer1 : PlayerId::kPlayer2;
-            cs_match.emplace_back( PlayerMatch { init_msg.p_id, -1 } );
-            for (int i = 0; i < cs.size() && cs.size() > 1; ++i) {
-                if (cs_match[i].match_player_index == -1) {
-                    cs_match[i].match_player_index = last_index;
-                    cs_match[last_index].match_player_index = i;
-                    cs_match[last_index].id = cs_match[i].id == PlayerId::kPlayer1 ? PlayerId::kPlayer2 : PlayerId::kPlayer1;
+            init_msg.tick = room.gs.tick;
+            init_msg.p_id = pm.id;
+            init_msg.input_rate = INPUT_RATE;
+            const auto buf { EncodeMessage(init_msg) };
+            nm.SendToClient(last_index, buf.data(), static_cast<int>(buf.size()));
+        }
+
+        std::vector<int> broken;  // clients sending what this build cannot read
+        nm.PollClients([&cs_match, &rooms, &broken](int index, const void* data, int size) -> void {
+            auto& m     { cs_match[index] };
+            auto* bytes { static_cast<const uint8_t*>(data) };
+            m.rx_buf.insert(m.rx_buf.end(), bytes, bytes + size);
+
+            // receive input message, anything else from a client is skipped
+            Room& room { rooms[m.room_id] };
+            const size_t used { DispatchMessages(m.rx_buf.data(), m.rx_buf.size(), [&m, &room](const PlayerInputMsg& msg) {
+                auto& p { (m.id == PlayerId::kPlayer1) ? room.gs.p1 : room.gs.p2 };  // trust server side id, not the message
+                if (msg.seq <= m.last_input_seq) return;  // old or duplicated
+
+                // inputs lost in between are still in the redundant history
+                const uint32_t missed { std::min<uint32_t>(msg.seq - m.last_input_seq - 1, INPUT_REDUNDANCY) };
+                for (uint32_t k = 0; k < missed; ++k) p.pending_mask |= msg.prev_masks[k];
+                if (msg.mask != p.input_mask || p.pending_mask) room.last_input_ns = SDL_GetTicksNS();  // not a heartbeat
+                p.input_mask    = msg.mask;
+                p.pending_mask |= msg.mask;
+
+                if (msg.trace_id && !m.trace_id) {
+                    m.trace_id       = msg.trace_id;
+                    m.trace_recv_ns  = SDL_GetTicksNS();
+                    m.trace_apply_ns = 0;
                 }
-                SDL_Log("clients match[%d]: id - %d, matched_index - %d", i, cs_match[i].id, cs_match[i].match_player_index);
+
+                m.last_input_seq      = msg.seq;
+                m.echo_client_time_ms = msg.client_time_ms;
+                m.echo_recv_ms        = SDL_GetTicks();
+            }) };
+            if (used == STREAM_BROKEN) {
+                m.rx_buf.clear();
+                broken.push_back(index);
+                return;
+            }
+            m.rx_buf.erase(m.rx_buf.begin(), m.rx_buf.begin() + used);
+        });
+        // highest index first, disconnecting moves the ones after it
+        std::sort(broken.rbegin(), broken.rend());
+        broken.erase(std::unique(broken.begin(), broken.end()), broken.end());
+        for (int i : broken) {
+            SDL_Log("client %d: unknown message, disconnected", i);
+            nm.DisconnectClient(i);
+        }
+        if (takeover_release_ns) {
+            // clients are served again: nothing was read from their sockets since the old server's last loop
+            SDL_Log("took over %d rooms, %d clients: handover gap %.2f ms (tick %.1f ms)", static_cast<int>(rooms.size()),
+                    static_cast<int>(cs.size()), (MonotonicNs() - takeover_release_ns) / 1e6, 1000.0f / RATE_LEVELS[0].tick_hz);
+            takeover_release_ns = 0;
+        }
+
+        // update each room at its own rate (not per input message)
+        const Uint64 now { SDL_GetTicksNS() };
+
+        // a player waited alone long enough, a bot takes the free side
+        for (auto& m : cs_match) {
+            if (bot_wait_s <= 0.0f || m.match_player_index != -1) continue;
+            Room& room { rooms[m.room_id] };
+            if (now - room.open_ns < static_cast<Uint64>(bot_wait_s * SDL_NS_PER_SECOND)) continue;
+
+            const bool bot_is_p1 { m.id == PlayerId::kPlayer2 };
+            (bot_is_p1 ? room.bot_p1 : room.bot_p2) = bots.Add(bot_is_p1 ? PlayerId::kPlayer1 : PlayerId::kPlayer2, bot_level, m.room_id);
+            (bot_is_p1 ? room.has_p1 : room.has_p2) = true;
+            room.last_input_ns   = now;
+            m.match_player_index = BOT_MATCH;
+            SDL_Log("room %u: bot joins as p%d", m.room_id, bot_is_p1 ? 1 : 2);
+        }
+
+        // bots look at their rooms, then all decide in one pass
+        if (bots.get_count() > 0) {
+            for (auto& [id, room] : rooms) {
+                const ServerGameState& gs { room.gs };
+                if (room.bot_p1 >= 0) bots.SetView(room.bot_p1, gs.ball_x, gs.ball_y, gs.ball_vx, gs.ball_vy, gs.p1.y);
+                if (room.bot_p2 >= 0) bots.SetView(room.bot_p2, gs.ball_x, gs.ball_y, gs.ball_vx, gs.ball_vy, gs.p2.y);
+            }
+            bots.Think(static_cast<float>(now - start_ns) / SDL_NS_PER_SECOND);
+            for (auto& [id, room] : rooms) {
+                if (room.bot_p1 >= 0) room.gs.p1.input_mask = bots.get_input_mask(room.bot_p1);
+                if (room.bot_p2 >= 0) room.gs.p2.input_mask = bots.get_input_mask(room.bot_p2);
             }
-            nm.SendToClient(last_index, &init_msg, sizeof(init_msg));
         }
 
-        nm.PollClients([&cs_match, &nm, &gs](int index, const void* data, int size) -> void {
-            // receive input message
-            auto* msg { reinterpret_cast<const PlayerInputMsg*>(data) };
-            auto& p   { (msg->p_id == PlayerId::kPlayer1) ? gs.p1 : gs.p2 };
-            p.input_mask = msg->mask;
-
-            // update world state
-            UpdateServerGame(gs);
-
-            // convey world state to p1 and p2(they are in a same world)
-            int matched_index { cs_match[index].match_player_index };
-            if (matched_index != -1) {
-                GameStateMsg s;
-                s.tick   = gs.tick;
-                s.echo_client_time_ms = msg->client_time_ms;  // echo time, assist the client in determining the timing of its own message sending
-                s.ball_x = gs.ball_x;
-                s.ball_y = gs.ball_y;
-                s.p1_y   = gs.p1.y;
-                s.p2_y   = gs.p2.y;
-                nm.SendToClient(index, &s, sizeof(s));
-                nm.SendToClient(matched_index, &s, sizeof(s));
+        schedules.clear();
+        for (auto& [id, room] : rooms) {
+            // waiting for a second player: frozen, no snapshot until the match starts
+            room.ticked = room.snapshot = false;
+            if (!(room.has_p1 && room.has_p2)) {
+                room.schedule.set_idle(true, now);
+                continue;
             }
-        });
 
-        gs.tick++;
-        SDL_Delay(33);
+            // no human pressing a key: almost stop, an input wakes it up at once
+            const bool afk { HasHuman(room) && now - room.last_input_ns > AFK_NS };
+            room.schedule.set_idle(afk, now);
+            schedules.push_back(&room.schedule);
+
+            room.ticked   = room.schedule.TickDue(now);
+            room.snapshot = room.schedule.SnapshotDue(now);
+            if (room.ticked) UpdateServerGame(room.gs, 1.0f / room.schedule.rate().tick_hz);
+        }
+        for (auto& m : cs_match) {
+            const Room& room { rooms[m.room_id] };
+            if (m.trace_id && !m.trace_apply_ns && room.ticked) {
+                m.trace_apply_ns = SDL_GetTicksNS();
+                m.trace_tick     = room.gs.tick;
+            }
+        }
+
+        // convey world state to the players of rooms due for a snapshot
+        for (int i = 0; i < static_cast<int>(cs.size()); ++i) {
+            auto& m { cs_match[i] };
+            const Room& room { rooms[m.room_id] };
+            if (!room.snapshot) continue;
+
+            const ServerGameState& gs { room.gs };
+            const RoomRate rate { room.schedule.rate() };
+            GameStateMsg s {};
+            s.tick   = gs.tick;
+            // echo time plus how long server held it, so client rtt stays right when input is idle
+            s.echo_client_time_ms = m.echo_client_time_ms + static_cast<Tick>(SDL_GetTicks() - m.echo_recv_ms);
+            s.ball_x = gs.ball_x;
+            s.ball_y = gs.ball_y;
+            s.p1_y   = gs.p1.y;
+            s.p2_y   = gs.p2.y;
+            s.tick_hz     = static_cast<uint8_t>(rate.tick_hz);
+            s.snapshot_hz = static_cast<uint8_t>(rate.snapshot_hz);
+
+            // a snapshot may be due in a loop where the room did not tick: echo the trace once applied
+            if (m.trace_id && m.trace_apply_ns) {
+                s.echo_trace_id  = m.trace_id;
+                s.trace_tick     = m.trace_tick;
+                s.trace_apply_us = static_cast<uint32_t>((m.trace_apply_ns - m.trace_recv_ns) / 1000);
+                s.trace_hold_us  = static_cast<uint32_t>((SDL_GetTicksNS() - m.trace_recv_ns) / 1000);
+                m.trace_id = 0;
+            }
+            const auto buf { EncodeMessage(s) };
+            nm.SendToClient(i, buf.data(), static_cast<int>(buf.size()));
+        }
+
+        // busy time against wall time decides the room rates
+        const Uint64 work_end { SDL_GetTicksNS() };
+        scheduler.AddWork(work_end - work_start);
+        scheduler.Update(work_end, schedules);
+
+        if (work_end - last_report > 5 * SDL_NS_PER_SECOND) {
+            int levels[RATE_LEVEL_COUNT] {};
+            int idle { 0 };
+            for (const RoomSchedule* r : schedules) {
+                if (r->idle) idle++;
+                else levels[r->level]++;
+            }
+            const int waiting { static_cast<int>(rooms.size() - schedules.size()) };
+            SDL_Log("load %.0f%%, rooms: %d waiting, %d idle, per rate level %d/%d/%d/%d/%d, bots: %d", scheduler.get_load() * 100.0f, waiting, idle,
+                    levels[0], levels[1], levels[2], levels[3], levels[4], static_cast<int>(bots.get_count()));
+            last_report = work_end;
+        }
+
+        // a new build asks for the server: hand everything over between two loops and quit
+        if (handoff && handoff->Requested()) {
+            const Uint64 release_ns { MonotonicNs() };
+            SocketHandoff sockets;
+            if (!nm.ExportSockets(sockets)) {
+                SDL_Log("handoff: sockets of this server cannot be handed over, keep serving");
+                handoff.reset();
+            } else if (handoff->Send(SaveState(release_ns, next_room_id, rooms, cs_match, sockets), sockets.fds)) {
+                SDL_Log("handed %d clients over in %.2f ms, bye", static_cast<int>(cs.size()), (MonotonicNs() - release_ns) / 1e6);
+                break;
+            }
+        }
+
+        // sleep until the next room is due
+        Uint64 wake { work_end + MAX_WAIT_NS };
+        for (const RoomSchedule* r : schedules) wake = std::min(wake, r->NextDue());
+        if (wake > work_end) SDL_DelayNS(wake - work_end);
     }
 
     return 0;
@@ -0,0 +1,75 @@
+#include "game.h"
+#include <cmath>
+#include <cstdio>
+
+// StepBall must give the same ball path whatever the tick rate (swept collision, no tunnelling).
+// exit code 0 = pass, failures are printed
+
+constexpr int   RATES[]      { 240, 120, 60, 30, 20, 15, 10, 5, 2 };
+constexpr float PADDLE_YS[]  { 0.0f, 100.0f, 225.0f, 380.0f, WINDOW_HEIGHT - PLAYER_HEIGHT };
+constexpr float SIM_SECONDS  { 20.0f };
+constexpr float TOLERANCE    { 0.05f };  // px
+
+// ball starts off the 45 degree grid of the paddle corners: an exact corner graze is decided
+// by float rounding, not by the tick rate, and would make the test flaky
+constexpr SDL_FPoint STARTS[] { { 371.3f, 263.7f }, { 120.9f, 401.1f }, { 610.2f, 57.5f } };
+
+struct BallState {
+    SDL_FRect body;
+    float vx, vy;
+};
+
+static BallState Simulate(SDL_FPoint start, int hz, float p1_y, float p2_y) {
+    const SDL_FRect p1 { 0.0f, p1_y, PLAYER_WIDTH, PLAYER_HEIGHT };
+    const SDL_FRect p2 { WINDOW_WIDTH - PLAYER_WIDTH, p2_y, PLAYER_WIDTH, PLAYER_HEIGHT };
+    BallState b { { start.x, start.y, BALL_WIDTH, BALL_HEIGHT }, BALL_SPEED, BALL_SPEED };
+    const int   steps { static_cast<int>(SIM_SECONDS * hz) };
+    const float dt    { 1.0f / hz };
+    for (int i = 0; i < steps; ++i) StepBall(b.body, b.vx, b.vy, p1, p2, dt);
+    return b;
+}
+
+static int CheckPath(SDL_FPoint start, float p1_y, float p2_y) {
+    int failed { 0 };
+    const BallState ref { Simulate(start, RATES[0], p1_y, p2_y) };
+    for (int hz : RATES) {
+        const BallState b { Simulate(start, hz, p1_y, p2_y) };
+        const bool same { std::fabs(b.body.x - ref.body.x) <= TOLERANCE && std::fabs(b.body.y - ref.body.y) <= TOLERANCE &&
+                          b.vx == ref.vx && b.vy == ref.vy };
+        if (same) continue;
+        std::printf("FAIL start (%.1f, %.1f) paddles %.0f/%.0f at %d Hz: ball (%.3f, %.3f) v (%.0f, %.0f), at %d Hz (%.3f, %.3f) v (%.0f, %.0f)\n",
+                    start.x, start.y, p1_y, p2_y, hz, b.body.x, b.body.y, b.vx, b.vy, RATES[0], ref.body.x, ref.body.y, ref.vx, ref.vy);
+        failed++;
+    }
+    return failed;
+}
+
+static int CheckTickRateInvariance() {
+    int failed { 0 };
+    for (SDL_FPoint start : STARTS) {
+        for (float p1_y : PADDLE_YS) {
+            for (float p2_y : PADDLE_YS) {
+                failed += CheckPath(start, p1_y, p2_y);
+            }
+        }
+    }
+    return failed;
+}
+
+// one big step must not pass through a paddle
+static int CheckNoTunnelling() {
+    const SDL_FRect p1 { 0.0f, 225.0f, PLAYER_WIDTH, PLAYER_HEIGHT };
+    const SDL_FRect p2 { WINDOW_WIDTH - PLAYER_WIDTH, 225.0f, PLAYER_WIDTH, PLAYER_HEIGHT };
+    SDL_FRect ball { 400.0f, 250.0f, BALL_WIDTH, BALL_HEIGHT };
+    float vx { -5000.0f }, vy { 0.0f };
+    StepBall(ball, vx, vy, p1, p2, 0.1f);  // 500 px, paddle face 355 px away
+    if (vx > 0.0f && ball.x >= PLAYER_WIDTH) return 0;
+    std::printf("FAIL tunnelling: ball x %.3f, vx %.0f\n", ball.x, vx);
+    return 1;
+}
+
+int main() {
+    const int failed { CheckTickRateInvariance() + CheckNoTunnelling() };
+    std::printf("%s (%d failed)\n", failed ? "FAIL" : "PASS", failed);
+    return failed ? 1 : 0;
+}